@@ -392,6 +392,7 @@ chop_commands (struct commands *cmds)
 
   cmds->ncommand_lines = nlines;
   cmds->command_lines = lines;
+  cmds->compiled_lines = xcalloc (nlines * sizeof (struct compiled_expansion *));
 
   cmds->any_recurse = 0;
   cmds->lines_flags = xmalloc (nlines);
@@ -549,6 +550,10 @@ fatal_error_signal (int sig)
 
   remove_intermediates (1);
 
+  /* Delete the FIFOs of the --shell-pool shells.  */
+
+  shell_pool_remove ();
+
 #ifdef SIGQUIT
   if (sig == SIGQUIT)
     /* We don't want to send ourselves SIGQUIT, because it will
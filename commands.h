@@ -22,6 +22,8 @@ struct commands
     gmk_floc fileinfo;          /* Where commands were defined.  */
     char *commands;             /* Commands text.  */
     char **command_lines;       /* Commands chopped up into lines.  */
+    struct compiled_expansion **compiled_lines;
+                                /* The lines compiled for expansion.  */
     char *lines_flags;          /* One set of flag bits for each line.  */
     unsigned short ncommand_lines;/* Number of command lines.  */
     char recipe_prefix;         /* Recipe prefix for this command set.  */
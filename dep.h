@@ -74,8 +74,11 @@ struct nameseq *ar_glob (const char *arname, const char *member_pattern, unsigne
 
 #define dep_name(d)     ((d)->name == 0 ? (d)->file->name : (d)->name)
 
-#define alloc_dep()     (xcalloc (sizeof (struct dep)))
-#define free_ns(_n)     free (_n)
+extern struct arena dep_arena;
+
+#define alloc_dep()     ((struct dep *) arena_alloc (&dep_arena))
+#define alloc_ns()      ((struct nameseq *) arena_alloc (&dep_arena))
+#define free_ns(_n)     arena_free (&dep_arena, (_n))
 #define free_dep(_d)    free_ns (_d)
 
 struct dep *copy_dep_chain (const struct dep *d);
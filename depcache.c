@@ -0,0 +1,306 @@
+/* Cache of parsed dependency makefiles for GNU Make.
+Copyright (C) 2015 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+#include "hash.h"
+#include "debug.h"
+
+/* Included makefiles written by compilers (gcc -MD and friends) contain
+   nothing but simple "target: prereq..." rules.  read.c reduces such
+   makefiles to a compact list of rules.  With --dep-cache those lists are
+   kept in a cache file, keyed by the name, size, inode and modification time
+   of the makefile, so a later make can record the rules without opening or
+   parsing the makefile again.
+
+   The cache file is text: a header line, then for each makefile a line
+
+     F <sec> <nsec> <size> <inode> <length> <name>
+
+   followed by LENGTH bytes of rules in the form produced by read.c.  */
+
+#define DEPCACHE_HEADER "# GNU make dependency cache, version 1\n"
+
+struct depcache_ent
+  {
+    const char *name;           /* Name of the makefile.  */
+    unsigned long sec;          /* Modification time of the makefile.  */
+    unsigned long nsec;
+    unsigned long size;         /* Size of the makefile.  */
+    unsigned long ino;          /* Inode of the makefile.  */
+    char *rules;                /* Rules, as reduced by read.c.  */
+    unsigned int len;           /* Length of RULES.  */
+    unsigned int used:1;        /* Nonzero if looked up or stored this run.  */
+    unsigned int allocated:1;   /* Nonzero if RULES must be freed.  */
+  };
+
+static unsigned long
+depcache_ent_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((const struct depcache_ent *) key)->name);
+}
+
+static unsigned long
+depcache_ent_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((const struct depcache_ent *) key)->name);
+}
+
+static int
+depcache_ent_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (((const struct depcache_ent *) x)->name,
+                         ((const struct depcache_ent *) y)->name);
+}
+
+static struct hash_table depcache;
+
+/* Nonzero once depcache_load() has been called.  */
+static int depcache_loaded = 0;
+
+/* Nonzero if the cache must be written out again.  */
+static int depcache_dirty = 0;
+
+/* The contents of the cache file as read; entries point into it.  */
+static char *depcache_contents = 0;
+
+/* Return nonzero if ENT describes the file whose status is ST.  */
+
+static int
+depcache_ent_matches (const struct depcache_ent *ent, const struct stat *st)
+{
+  return (ent->sec == (unsigned long) st->st_mtime
+          && ent->nsec == (unsigned long) STAT_MTIME_NS (*st)
+          && ent->size == (unsigned long) st->st_size
+          && ent->ino == (unsigned long) st->st_ino);
+}
+
+/* Parse a decimal number at *PP, followed by a single space.  */
+
+static int
+depcache_number (char **pp, unsigned long *np)
+{
+  char *p = *pp;
+
+  if (! ISDIGIT (*p))
+    return 0;
+
+  errno = 0;
+  *np = strtoul (p, &p, 10);
+  if (errno != 0 || *p != ' ')
+    return 0;
+
+  *pp = p + 1;
+  return 1;
+}
+
+/* Read the cache in FILE.  If it is damaged, start with an empty one.  */
+
+void
+depcache_load (const char *file)
+{
+  char *p, *end;
+  size_t len;
+
+  hash_init (&depcache, 1000, depcache_ent_hash_1, depcache_ent_hash_2,
+             depcache_ent_hash_cmp);
+  depcache_loaded = 1;
+
+  depcache_contents = read_cache_file (file, &len);
+  if (depcache_contents == 0)
+    {
+      DB (DB_VERBOSE, (_("No dependency cache '%s' found.\n"), file));
+      return;
+    }
+
+  p = depcache_contents;
+  end = p + len;
+
+  if (len < CSTRLEN (DEPCACHE_HEADER)
+      || ! strneq (p, DEPCACHE_HEADER, CSTRLEN (DEPCACHE_HEADER)))
+    goto damaged;
+  p += CSTRLEN (DEPCACHE_HEADER);
+
+  while (p < end)
+    {
+      struct depcache_ent *ent;
+      unsigned long sec, nsec, size, ino, rlen;
+      char *name;
+
+      if (p[0] != 'F' || p[1] != ' ')
+        goto damaged;
+      p += 2;
+
+      if (! depcache_number (&p, &sec) || ! depcache_number (&p, &nsec)
+          || ! depcache_number (&p, &size) || ! depcache_number (&p, &ino)
+          || ! depcache_number (&p, &rlen))
+        goto damaged;
+
+      name = p;
+      p = strchr (p, '\n');
+      if (p == 0 || p == name || rlen > UINT_MAX
+          || rlen > (unsigned long) (end - p - 1))
+        goto damaged;
+      *(p++) = '\0';
+
+      ent = xmalloc (sizeof (struct depcache_ent));
+      ent->name = strcache_add (name);
+      ent->sec = sec;
+      ent->nsec = nsec;
+      ent->size = size;
+      ent->ino = ino;
+      ent->rules = p;
+      ent->len = rlen;
+      ent->used = 0;
+      ent->allocated = 0;
+      hash_insert (&depcache, ent);
+
+      p += rlen;
+    }
+
+  DB (DB_VERBOSE, (_("Read dependency cache '%s' (%lu entries).\n"),
+                   file, depcache.ht_fill));
+  return;
+
+ damaged:
+  DB (DB_BASIC, (_("Ignoring damaged dependency cache '%s'.\n"), file));
+  hash_free (&depcache, 1);
+  hash_init (&depcache, 1000, depcache_ent_hash_1, depcache_ent_hash_2,
+             depcache_ent_hash_cmp);
+  free (depcache_contents);
+  depcache_contents = 0;
+  depcache_dirty = 1;
+}
+
+/* If the cache has an up-to-date entry for the makefile NAME, return its
+   rules and set *LENP to their length.  Otherwise return NULL.  */
+
+const char *
+depcache_lookup (const char *name, unsigned int *lenp)
+{
+  struct depcache_ent key;
+  struct depcache_ent *ent;
+  struct stat st;
+  int e;
+
+  if (! depcache_loaded)
+    return 0;
+
+  key.name = name;
+  ent = hash_find_item (&depcache, &key);
+  if (ent == 0)
+    return 0;
+
+  EINTRLOOP (e, stat (name, &st));
+  if (e != 0 || ! depcache_ent_matches (ent, &st))
+    return 0;
+
+  ent->used = 1;
+  *lenp = ent->len;
+  return ent->rules;
+}
+
+/* Remember RULES, LEN bytes long, for the makefile NAME whose status when it
+   was read was ST.  */
+
+void
+depcache_store (const char *name, const struct stat *st,
+                const char *rules, unsigned int len)
+{
+  struct depcache_ent key;
+  struct depcache_ent **slot;
+  struct depcache_ent *ent;
+
+  if (! depcache_loaded)
+    return;
+
+  /* If the makefile was modified within the last second it might still be
+     changing without its timestamp moving on; don't trust it yet.  */
+  if ((unsigned long) st->st_mtime + 1 >= (unsigned long) time (0))
+    return;
+
+  key.name = name;
+  slot = (struct depcache_ent **) hash_find_slot (&depcache, &key);
+  ent = *slot;
+  if (HASH_VACANT (ent))
+    {
+      ent = xmalloc (sizeof (struct depcache_ent));
+      ent->name = strcache_add (name);
+      hash_insert_at (&depcache, ent, slot);
+    }
+  else if (ent->allocated)
+    free (ent->rules);
+
+  ent->sec = st->st_mtime;
+  ent->nsec = STAT_MTIME_NS (*st);
+  ent->size = st->st_size;
+  ent->ino = st->st_ino;
+  ent->rules = xmalloc (len);
+  memcpy (ent->rules, rules, len);
+  ent->len = len;
+  ent->used = 1;
+  ent->allocated = 1;
+
+  depcache_dirty = 1;
+}
+
+/* Write one cache entry to the FILE * in ARG.  Entries that weren't used in
+   this run are kept unless their makefile has disappeared.  */
+
+static void
+depcache_write_ent (const void *item, void *arg)
+{
+  const struct depcache_ent *ent = item;
+  FILE *fp = arg;
+
+  if (! ent->used)
+    {
+      struct stat st;
+      int e;
+
+      EINTRLOOP (e, stat (ent->name, &st));
+      if (e != 0)
+        return;
+    }
+
+  fprintf (fp, "F %lu %lu %lu %lu %u %s\n",
+           ent->sec, ent->nsec, ent->size, ent->ino, ent->len, ent->name);
+  fwrite (ent->rules, 1, ent->len, fp);
+}
+
+/* Write the whole cache to FP.  */
+
+static void
+depcache_write (FILE *fp)
+{
+  fputs (DEPCACHE_HEADER, fp);
+  hash_map_arg (&depcache, depcache_write_ent, fp);
+}
+
+/* Write the cache back to FILE, if anything changed.  */
+
+void
+depcache_save (const char *file)
+{
+  if (! depcache_loaded || ! depcache_dirty)
+    return;
+
+  if (replace_cache_file (file, depcache_write))
+    {
+      DB (DB_VERBOSE, (_("Wrote dependency cache '%s' (%lu entries).\n"),
+                       file, depcache.ht_fill));
+      depcache_dirty = 0;
+    }
+}
@@ -128,19 +128,32 @@ static struct hash_table directories;
 static unsigned int open_directories = 0;
 
 
-/* Hash table of files in each directory.  */
+/* Hash table of files in each directory.
+
+   The names of the files in it are in the strcache, so their hash need not
+   be computed again when the table grows, and two of them are the same name
+   only if they are the same pointer.  The keys they are looked up with may
+   not be: those have a zero 'cached'.  */
 
 struct dirfile
   {
     const char *name;           /* Name of the file.  */
     short length;
     short impossible;           /* This file is impossible.  */
+    short cached;               /* NAME is in the strcache.  */
   };
 
 static unsigned long
 dirfile_hash_1 (const void *key)
 {
-  return_ISTRING_HASH_1 (((struct dirfile const *) key)->name);
+  struct dirfile const *df = key;
+  unsigned long hash = 0;
+
+  if (df->cached)
+    return strcache_hash (df->name);
+
+  ISTRING_HASH_1 (df->name, hash);
+  return (unsigned int) hash;
 }
 
 static unsigned long
@@ -157,6 +170,8 @@ dirfile_hash_cmp (const void *xv, const void *yv)
   int result = x->length - y->length;
   if (result)
     return result;
+  if (x->cached && y->cached)
+    return x->name != y->name;
   return_ISTRING_COMPARE (x->name, y->name);
 }
 
@@ -195,7 +210,13 @@ find_directory (const char *name)
       /* The directory is not in the name hash table.
          Find its device and inode numbers, and look it up by them.  */
 
-      EINTRLOOP (r, stat (name, &st));
+      if (! prefetched_stat (name, &st, 0, &r))
+        {
+          STATS_START (STATS_STAT);
+          EINTRLOOP (r, stat (name, &st));
+          STATS_STOP (STATS_STAT);
+          STATS_COUNT (STATS_STATS);
+        }
 
       if (r < 0)
         {
@@ -227,7 +248,10 @@ find_directory (const char *name)
               dc->ino = st.st_ino;
 
               hash_insert_at (&directory_contents, dc, dc_slot);
+              STATS_START (STATS_READDIR);
               ENULLLOOP (dc->dirstream, opendir (name));
+              STATS_STOP (STATS_READDIR);
+              STATS_COUNT (STATS_DIRS);
               if (dc->dirstream == 0)
                 /* Couldn't open the directory.  Mark this by setting the
                    'files' member to a nil pointer.  */
@@ -278,6 +302,7 @@ dir_contents_file_exists_p (struct directory_contents *dir,
         }
       dirfile_key.name = filename;
       dirfile_key.length = strlen (filename);
+      dirfile_key.cached = 0;
       df = hash_find_item (&dir->dirfiles, &dirfile_key);
       if (df)
         return !df->impossible;
@@ -292,6 +317,8 @@ dir_contents_file_exists_p (struct directory_contents *dir,
         return 0;
     }
 
+  STATS_START (STATS_READDIR);
+
   while (1)
     {
       /* Enter the file in the hash table.  */
@@ -307,26 +334,35 @@ dir_contents_file_exists_p (struct directory_contents *dir,
           break;
         }
 
+      STATS_COUNT (STATS_DIRENTS);
+
       if (!REAL_DIR_ENTRY (d))
         continue;
 
       len = NAMLEN (d);
       dirfile_key.name = d->d_name;
       dirfile_key.length = len;
+      dirfile_key.cached = 0;
       dirfile_slot = (struct dirfile **) hash_find_slot (&dir->dirfiles, &dirfile_key);
         {
           df = xmalloc (sizeof (struct dirfile));
           df->name = strcache_add_len (d->d_name, len);
           df->length = len;
           df->impossible = 0;
+          df->cached = 1;
           hash_insert_at (&dir->dirfiles, df, dirfile_slot);
         }
 
       /* Check if the name matches the one we're searching for.  */
       if (filename != 0 && patheq (d->d_name, filename))
-        return 1;
+        {
+          STATS_STOP (STATS_READDIR);
+          return 1;
+        }
     }
 
+  STATS_STOP (STATS_READDIR);
+
   /* If the directory has been completely read in,
      close the stream and reset the pointer to nil.  */
   if (d == 0)
@@ -432,6 +468,7 @@ file_impossible (const char *filename)
   new->length = strlen (filename);
   new->name = strcache_add_len (filename, new->length);
   new->impossible = 1;
+  new->cached = 1;
   hash_insert (&dir->contents->dirfiles, new);
 }
 
@@ -474,6 +511,7 @@ file_impossible_p (const char *filename)
 
   dirfile_key.name = filename;
   dirfile_key.length = strlen (filename);
+  dirfile_key.cached = 0;
   dirfile = hash_find_item (&dir->dirfiles, &dirfile_key);
   if (dirfile)
     return dirfile->impossible;
@@ -490,6 +528,15 @@ dir_name (const char *dir)
   return find_directory (dir)->name;
 }
 
+/* Print the hash table statistics for --stats.  */
+
+void
+print_dir_stats (void)
+{
+  stats_print_hash (_("directories"), &directories);
+  stats_print_hash (_("directory contents"), &directory_contents);
+}
+
 /* Print the data base of directories.  */
 
 void
@@ -88,14 +88,16 @@ initialize_variable_output (void)
   return variable_buffer;
 }
 
-/* Recursively expand V.  The returned string is malloc'd.  */
+/* Expand V, a recursively expanded variable, for FILE.  The result is
+   written to O, which must point into 'variable_buffer', and the updated
+   pointer into the buffer is returned.  */
 
 static char *allocated_variable_append (const struct variable *v);
+static char *variable_value_output (char *o, struct variable *v);
 
-char *
-recursively_expand_for_file (struct variable *v, struct file *file)
+static char *
+expand_recursive_variable (char *o, struct variable *v, struct file *file)
 {
-  char *value;
   const gmk_floc *this_var;
   const gmk_floc **saved_varp;
   struct variable_set_list *save = 0;
@@ -135,9 +137,16 @@ recursively_expand_for_file (struct variable *v, struct file *file)
 
   v->expanding = 1;
   if (v->append)
-    value = allocated_variable_append (v);
+    {
+      char *value;
+
+      expansion_not_pure ();
+      value = allocated_variable_append (v);
+      o = variable_buffer_output (o, value, strlen (value));
+      free (value);
+    }
   else
-    value = allocated_variable_expand (v->value);
+    o = variable_value_output (o, v);
   v->expanding = 0;
 
   if (set_reading)
@@ -148,7 +157,130 @@ recursively_expand_for_file (struct variable *v, struct file *file)
 
   expanding_var = saved_varp;
 
-  return value;
+  return o;
+}
+
+/* Recursively expand V.  The returned string is malloc'd.  */
+
+char *
+recursively_expand_for_file (struct variable *v, struct file *file)
+{
+  char *o;
+
+  char *obuf = variable_buffer;
+  unsigned int olen = variable_buffer_length;
+
+  variable_buffer = 0;
+
+  o = expand_recursive_variable (initialize_variable_output (), v, file);
+  variable_buffer_output (o, "\0", 2);
+  o = variable_buffer;
+
+  variable_buffer = obuf;
+  variable_buffer_length = olen;
+
+  return o;
+}
+
+/* Memoized expansions.
+
+   Expanding a recursively expanded variable whose value refers only to
+   global variables, and calls only pure functions, gives the same result
+   each time until one of those variables changes.  So while a variable is
+   expanded, the variables its expansion looks up are recorded, along with
+   whether it did anything else.  If it did not, the result is kept with the
+   variable's compiled value, and it is copied by later expansions as long as
+   the global variables are unchanged and each name still finds the same
+   variable: no target-specific or automatic variable is in the way.  */
+
+struct memo_dep
+  {
+    const char *name;           /* The name looked up.  */
+    unsigned int length;        /* Its length.  */
+    struct variable *v;         /* The global variable found, or null.  */
+  };
+
+struct memo_record
+  {
+    struct memo_dep *deps;
+    unsigned int ndeps;
+    unsigned int max;
+    int impure;                 /* Nonzero if the result cannot be kept.  */
+  };
+
+/* Expansions with more lookups than this are not memoized.  */
+#define MEMO_MAX_DEPS   64
+
+/* The record for the variable being expanded, or null.  */
+static struct memo_record *memo_record = 0;
+
+/* Note that the expansion in progress cannot be memoized.  */
+
+void
+expansion_not_pure (void)
+{
+  if (memo_record)
+    memo_record->impure = 1;
+}
+
+/* Record in R that looking up the LENGTH chars at NAME found V.  */
+
+static void
+record_lookup (struct memo_record *r, const char *name, unsigned int length,
+               struct variable *v)
+{
+  unsigned int i;
+
+  if (r->impure)
+    return;
+
+  /* A variable that is not global may not be there next time, and special
+     variables change by themselves.  With --warn-undefined-variables,
+     looking up an undefined variable says so.  */
+  if (v != 0 ? !v->global || v->special : warn_undefined_variables_flag)
+    {
+      r->impure = 1;
+      return;
+    }
+
+  for (i = 0; i < r->ndeps; ++i)
+    if (r->deps[i].v == v
+        && (v != 0
+            || (r->deps[i].length == length
+                && strneq (r->deps[i].name, name, length))))
+      return;
+
+  if (r->ndeps == MEMO_MAX_DEPS)
+    {
+      r->impure = 1;
+      return;
+    }
+
+  if (r->ndeps == r->max)
+    {
+      r->max = r->max ? 2 * r->max : 8;
+      r->deps = xrealloc (r->deps, r->max * sizeof (struct memo_dep));
+    }
+
+  /* Keep a name that is not a variable's in the strcache.  */
+  r->deps[r->ndeps].name = v ? v->name : strcache_add_len (name, length);
+  r->deps[r->ndeps].length = length;
+  r->deps[r->ndeps].v = v;
+  ++r->ndeps;
+}
+
+/* Look up the variable named by the LENGTH chars at NAME, recording it for
+   the expansion in progress.  */
+
+static struct variable *
+lookup_memo_variable (const char *name, unsigned int length)
+{
+  struct variable *v = lookup_variable (name, length);
+
+  if (memo_record)
+    record_lookup (memo_record, name, length, v);
+
+  return v;
 }
 
 /* Expand a simple reference to variable NAME, which is LENGTH chars long.  */
@@ -160,9 +292,8 @@ static char *
 reference_variable (char *o, const char *name, unsigned int length)
 {
   struct variable *v;
-  char *value;
 
-  v = lookup_variable (name, length);
+  v = lookup_memo_variable (name, length);
 
   if (v == 0)
     warn_undefined (name, length);
@@ -171,16 +302,127 @@ reference_variable (char *o, const char *name, unsigned int length)
   if (v == 0 || (*v->value == '\0' && !v->append))
     return o;
 
-  value = (v->recursive ? recursively_expand (v) : v->value);
+  /* Expand a recursive variable where its value goes, rather than into a
+     buffer of its own that is then copied.  */
+  if (v->recursive)
+    return expand_recursive_variable (o, v, NULL);
 
-  o = variable_buffer_output (o, value, strlen (value));
+  return variable_buffer_output (o, v->value, strlen (v->value));
+}
 
-  if (v->recursive)
-    free (value);
+/* Expand a substitution reference $(NAME:PATTERN=REPLACE), where NAME is
+   LENGTH chars long.  PATTERN and REPLACE, and the percents in them, are as
+   patsubst_expand_pat wants them.  */
+
+static char *
+substitute_reference (char *o, const char *name, unsigned int length,
+                      const char *pattern, const char *replace,
+                      const char *ppercent, const char *rpercent)
+{
+  struct variable *v;
+
+  /* Look up the variable.  */
+  v = lookup_memo_variable (name, length);
+  if (v == 0)
+    warn_undefined (name, length);
+
+  /* If the variable is not empty, perform the substitution.  */
+  if (v != 0 && *v->value != '\0')
+    {
+      char *value = (v->recursive ? recursively_expand (v) : v->value);
+
+      o = patsubst_expand_pat (o, value, pattern, replace, ppercent, rpercent);
+
+      if (v->recursive)
+        free (value);
+    }
 
   return o;
 }
 
+/* Copy the pattern and the replacement of a substitution reference, from
+   SUBST_BEG to SUBST_END and from REPLACE_BEG to REPLACE_END, to BUF, which
+   has room for both and four more chars.  Set *PATTERNP, *REPLACEP,
+   *PPERCENTP and *RPERCENTP as substitute_reference wants them.  */
+
+static void
+split_substitution (char *buf, const char *subst_beg, const char *subst_end,
+                    const char *replace_beg, const char *replace_end,
+                    char **patternp, char **replacep,
+                    char **ppercentp, char **rpercentp)
+{
+  char *pattern, *replace, *ppercent, *rpercent;
+
+  /* Copy the pattern and the replacement.  Add in an extra % at the
+     beginning to use in case there isn't one in the pattern.  */
+  pattern = buf;
+  *(pattern++) = '%';
+  memcpy (pattern, subst_beg, subst_end - subst_beg);
+  pattern[subst_end - subst_beg] = '\0';
+
+  replace = pattern + (subst_end - subst_beg) + 1;
+  *(replace++) = '%';
+  memcpy (replace, replace_beg, replace_end - replace_beg);
+  replace[replace_end - replace_beg] = '\0';
+
+  /* Look for %.  Set the percent pointers properly
+     based on whether we find one or not.  */
+  ppercent = find_percent (pattern);
+  if (ppercent)
+    {
+      ++ppercent;
+      rpercent = find_percent (replace);
+      if (rpercent)
+        ++rpercent;
+    }
+  else
+    {
+      ppercent = pattern;
+      rpercent = replace;
+      --pattern;
+      --replace;
+    }
+
+  *patternp = pattern;
+  *replacep = replace;
+  *ppercentp = ppercent;
+  *rpercentp = rpercent;
+}
+
+/* Expand the reference whose text, with any references inside it already
+   expanded, runs from BEG to END: an ordinary variable reference or a
+   substitution reference.  */
+
+static char *
+expand_reference (char *o, const char *beg, const char *end)
+{
+  const char *colon = lindex (beg, end, ':');
+
+  if (colon)
+    {
+      /* This looks like a substitution reference: $(FOO:A=B).  */
+      const char *subst_beg = colon + 1;
+      const char *subst_end = lindex (subst_beg, end, '=');
+
+      /* If there is no = in sight, punt on the substitution reference and
+         treat this as a variable name containing a colon.  */
+      if (subst_end != 0)
+        {
+          char *pattern, *replace, *ppercent, *rpercent;
+          char *buf = alloca ((end - subst_beg) + 4);
+
+          split_substitution (buf, subst_beg, subst_end, subst_end + 1, end,
+                              &pattern, &replace, &ppercent, &rpercent);
+          return substitute_reference (o, beg, colon - beg, pattern, replace,
+                                       ppercent, rpercent);
+        }
+    }
+
+  /* This is an ordinary variable reference.
+     Look up the value of the variable.  */
+  return reference_variable (o, beg, end - beg);
+}
+
 /* Scan STRING for variable references and expansion-function calls.  Only
    LENGTH bytes of STRING are actually scanned.  If LENGTH is -1, scan until
    a null byte is found.
@@ -193,12 +435,13 @@ reference_variable (char *o, const char *name, unsigned int length)
 char *
 variable_expand_string (char *line, const char *string, long length)
 {
-  struct variable *v;
   const char *p, *p1;
   char *save;
   char *o;
   unsigned int line_offset;
 
+  STATS_COUNT (STATS_EXPANSIONS);
+
   if (!line)
     line = initialize_variable_output ();
   o = line;
@@ -207,9 +450,11 @@ variable_expand_string (char *line, const char *string, long length)
   if (length == 0)
     {
       variable_buffer_output (o, "", 1);
-      return (variable_buffer);
+      return (variable_buffer + line_offset);
     }
 
+  STATS_START (STATS_EXPAND);
+
   /* We need a copy of STRING: due to eval, it's possible that it will get
      freed as we process it (it might be the value of a variable that's reset
      for example).  Also having a nil-terminated string is handy.  */
@@ -251,7 +496,7 @@ variable_expand_string (char *line, const char *string, long length)
             const char *beg = p + 1;
             char *op;
             char *abeg = NULL;
-            const char *end, *colon;
+            const char *end;
 
             op = o;
             begp = p;
@@ -299,85 +544,8 @@ variable_expand_string (char *line, const char *string, long length)
               p = end;
 
             /* This is not a reference to a built-in function and
-               any variable references inside are now expanded.
-               Is the resultant text a substitution reference?  */
-
-            colon = lindex (beg, end, ':');
-            if (colon)
-              {
-                /* This looks like a substitution reference: $(FOO:A=B).  */
-                const char *subst_beg = colon + 1;
-                const char *subst_end = lindex (subst_beg, end, '=');
-                if (subst_end == 0)
-                  /* There is no = in sight.  Punt on the substitution
-                     reference and treat this as a variable name containing
-                     a colon, in the code below.  */
-                  colon = 0;
-                else
-                  {
-                    const char *replace_beg = subst_end + 1;
-                    const char *replace_end = end;
-
-                    /* Extract the variable name before the colon
-                       and look up that variable.  */
-                    v = lookup_variable (beg, colon - beg);
-                    if (v == 0)
-                      warn_undefined (beg, colon - beg);
-
-                    /* If the variable is not empty, perform the
-                       substitution.  */
-                    if (v != 0 && *v->value != '\0')
-                      {
-                        char *pattern, *replace, *ppercent, *rpercent;
-                        char *value = (v->recursive
-                                       ? recursively_expand (v)
-                                       : v->value);
-
-                        /* Copy the pattern and the replacement.  Add in an
-                           extra % at the beginning to use in case there
-                           isn't one in the pattern.  */
-                        pattern = alloca (subst_end - subst_beg + 2);
-                        *(pattern++) = '%';
-                        memcpy (pattern, subst_beg, subst_end - subst_beg);
-                        pattern[subst_end - subst_beg] = '\0';
-
-                        replace = alloca (replace_end - replace_beg + 2);
-                        *(replace++) = '%';
-                        memcpy (replace, replace_beg,
-                               replace_end - replace_beg);
-                        replace[replace_end - replace_beg] = '\0';
-
-                        /* Look for %.  Set the percent pointers properly
-                           based on whether we find one or not.  */
-                        ppercent = find_percent (pattern);
-                        if (ppercent)
-                          {
-                            ++ppercent;
-                            rpercent = find_percent (replace);
-                            if (rpercent)
-                              ++rpercent;
-                          }
-                        else
-                          {
-                            ppercent = pattern;
-                            rpercent = replace;
-                            --pattern;
-                            --replace;
-                          }
-
-                        o = patsubst_expand_pat (o, value, pattern, replace,
-                                                 ppercent, rpercent);
-
-                        if (v->recursive)
-                          free (value);
-                      }
-                  }
-              }
-
-            if (colon == 0)
-              /* This is an ordinary variable reference.
-                 Look up the value of the variable.  */
-                o = reference_variable (o, beg, end - beg);
+               any variable references inside are now expanded.  */
+            o = expand_reference (o, beg, end);
 
             free (abeg);
           }
@@ -403,6 +571,8 @@ variable_expand_string (char *line, const char *string, long length)
   free (save);
 
   variable_buffer_output (o, "", 1);
+  STATS_STOP (STATS_EXPAND);
+
   return (variable_buffer + line_offset);
 }
 
@@ -450,6 +620,666 @@ expand_argument (const char *str, const char *end)
   return r;
 }
 
+/* Compiled expansions.
+
+   The value of a recursively expanded variable is expanded again each time
+   the variable is referenced.  Rather than scan it for references and
+   function calls each time, the first expansion compiles it into a list of
+   steps, which is kept with the variable until its value changes.  Each step
+   is one of:
+
+     EXP_TEXT       text copied as it is
+     EXP_VARIABLE   a reference to a variable whose name is in the text
+     EXP_SUBST      a substitution reference $(NAME:A=B), split
+     EXP_COMPUTED   a reference whose name has references in it, compiled
+     EXP_CALL       a call to a builtin function, its arguments split and, if
+                    they are expanded, compiled
+
+   Values that variable_expand_string would stop on, or report an error for,
+   are not compiled: they are expanded by it as before.  */
+
+enum exp_step_type
+  {
+    EXP_TEXT,
+    EXP_VARIABLE,
+    EXP_SUBST,
+    EXP_COMPUTED,
+    EXP_CALL
+  };
+
+struct exp_step
+  {
+    enum exp_step_type type;
+    unsigned int len;           /* Length of TEXT.  */
+    const char *text;           /* The text, or the variable name.  For
+                                   EXP_CALL, the unexpanded arguments.  */
+    union
+      {
+        struct
+          {
+            char *buf;          /* Holds the pattern and the replacement.  */
+            char *pattern;
+            char *replace;
+            char *ppercent;
+            char *rpercent;
+          } subst;
+        struct compiled_expansion *name;
+        struct
+          {
+            const struct function_table_entry *entry_p;
+            struct compiled_expansion **args; /* Expanded arguments.  */
+            int nargs;
+            int expand;
+          } call;
+      } u;
+  };
+
+struct compiled_expansion
+  {
+    const char *value;          /* The variable value this was compiled from.  */
+    unsigned int refs;          /* Its variable and the expansions running.  */
+    unsigned int functions;     /* functions_defined when it was compiled.  */
+    unsigned int nsteps;
+    unsigned int max;
+    struct exp_step *steps;
+    int interpret;              /* Nonzero if it could not be compiled.  */
+    char *memo;                 /* The memoized expansion, or null.  */
+    unsigned int memo_len;      /* Its length.  */
+    unsigned long memo_changes; /* global_variable_changes when it was made.  */
+    struct memo_dep *memo_deps; /* The lookups it depends on.  */
+    unsigned int memo_ndeps;
+    char text[1];               /* A copy of the text.  */
+  };
+
+static struct compiled_expansion *compile_expansion (const char *text,
+                                                     unsigned int len);
+static void free_expansion (struct compiled_expansion *c);
+
+static void
+free_steps (struct compiled_expansion *c)
+{
+  unsigned int i;
+
+  for (i = 0; i < c->nsteps; ++i)
+    {
+      struct exp_step *s = &c->steps[i];
+      int a;
+
+      switch (s->type)
+        {
+        case EXP_SUBST:
+          free (s->u.subst.buf);
+          break;
+
+        case EXP_COMPUTED:
+          free_expansion (s->u.name);
+          break;
+
+        case EXP_CALL:
+          if (!s->u.call.expand)
+            free ((char *) s->text);
+          else if (s->u.call.args)
+            {
+              for (a = 0; a < s->u.call.nargs; ++a)
+                if (s->u.call.args[a])
+                  free_expansion (s->u.call.args[a]);
+              free (s->u.call.args);
+            }
+          break;
+
+        default:
+          break;
+        }
+    }
+
+  free (c->steps);
+  c->steps = 0;
+  c->nsteps = c->max = 0;
+}
+
+static void
+free_expansion (struct compiled_expansion *c)
+{
+  free_steps (c);
+  free (c->memo);
+  free (c->memo_deps);
+  free (c);
+}
+
+static void
+release_expansion (struct compiled_expansion *c)
+{
+  if (--c->refs == 0)
+    free_expansion (c);
+}
+
+/* Forget the compiled value of V, if it has one.  This must be done before
+   its value is freed.  If the compiled value is being expanded, it is freed
+   when that is finished.  */
+
+void
+forget_compiled_value (struct variable *v)
+{
+  if (v->compiled)
+    {
+      release_expansion (v->compiled);
+      v->compiled = 0;
+    }
+}
+
+/* Add a step of TYPE for the LEN chars at TEXT to C.  Text that follows
+   other text is joined to it.  */
+
+static struct exp_step *
+add_step (struct compiled_expansion *c, enum exp_step_type type,
+          const char *text, unsigned int len)
+{
+  struct exp_step *s;
+
+  if (type == EXP_TEXT && c->nsteps > 0
+      && c->steps[c->nsteps - 1].type == EXP_TEXT)
+    {
+      /* Only the $ of a $$ can be between them, so move TEXT over it.  */
+      s = &c->steps[c->nsteps - 1];
+      memmove ((char *) s->text + s->len, text, len);
+      s->len += len;
+      return s;
+    }
+
+  if (c->nsteps == c->max)
+    {
+      c->max = c->max ? 2 * c->max : 4;
+      c->steps = xrealloc (c->steps, c->max * sizeof (struct exp_step));
+    }
+
+  s = &c->steps[c->nsteps++];
+  s->type = type;
+  s->text = text;
+  s->len = len;
+  return s;
+}
+
+/* Compile the arguments of a call to ENTRY_P, split by split_function into
+   ARGS, into a step of C.  Return zero if they cannot be compiled.  */
+
+static int
+compile_call (struct compiled_expansion *c,
+              const struct function_table_entry *entry_p, int expand,
+              const char **args, int nargs)
+{
+  struct exp_step *s = add_step (c, EXP_CALL, 0, 0);
+  int i;
+
+  s->u.call.entry_p = entry_p;
+  s->u.call.nargs = nargs;
+  s->u.call.expand = expand;
+  s->u.call.args = 0;
+
+  if (!expand)
+    {
+      /* Keep the arguments one after the other, each null-terminated.  */
+      char *p;
+
+      for (i = 0; i < nargs; ++i)
+        s->len += args[2 * i + 1] - args[2 * i] + 1;
+      s->text = p = xmalloc (s->len);
+
+      for (i = 0; i < nargs; ++i)
+        {
+          unsigned int len = args[2 * i + 1] - args[2 * i];
+          memcpy (p, args[2 * i], len);
+          p[len] = '\0';
+          p += len + 1;
+        }
+
+      return 1;
+    }
+
+  s->u.call.args = xcalloc (nargs * sizeof (struct compiled_expansion *));
+
+  for (i = 0; i < nargs; ++i)
+    if (args[2 * i] != args[2 * i + 1])
+      {
+        struct compiled_expansion *a
+          = compile_expansion (args[2 * i], args[2 * i + 1] - args[2 * i]);
+
+        if (a->interpret)
+          {
+            free_expansion (a);
+            return 0;
+          }
+        s->u.call.args[i] = a;
+      }
+
+  return 1;
+}
+
+/* Compile the reference or function call at *PP, which points at the
+   opening ( or {, into C.  Leave *PP at the end of it, as
+   variable_expand_string would.  Return zero if it cannot be compiled.  */
+
+static int
+compile_reference (struct compiled_expansion *c, const char **pp)
+{
+  const struct function_table_entry *entry_p;
+  char openparen = **pp;
+  char closeparen = (openparen == '(') ? ')' : '}';
+  const char *beg = *pp + 1;
+  const char *end, *colon;
+  const char **args;
+  int expand, nargs;
+
+  entry_p = split_function (pp, &expand, &args, &nargs);
+  if (entry_p)
+    {
+      int ok;
+
+      if (nargs == 0)
+        /* An unterminated call.  */
+        return 0;
+
+      ok = compile_call (c, entry_p, expand, args, nargs);
+      free (args);
+      return ok;
+    }
+
+  end = strchr (beg, closeparen);
+  if (end == 0)
+    /* An unterminated reference.  */
+    return 0;
+
+  if (lindex (beg, end, '$') != 0)
+    {
+      /* The name has references in it.  Find the matching paren or brace
+         and compile the name.  */
+      struct compiled_expansion *name;
+      const char *p;
+      int count = 0;
+
+      for (p = beg; *p != '\0'; ++p)
+        {
+          if (*p == openparen)
+            ++count;
+          else if (*p == closeparen && --count < 0)
+            break;
+        }
+
+      /* Leave names such as '$($(a)' to variable_expand_string.  */
+      if (count >= 0)
+        return 0;
+
+      name = compile_expansion (beg, p - beg);
+      if (name->interpret)
+        {
+          free_expansion (name);
+          return 0;
+        }
+
+      add_step (c, EXP_COMPUTED, beg, p - beg)->u.name = name;
+      *pp = p;
+      return 1;
+    }
+
+  *pp = end;
+
+  colon = lindex (beg, end, ':');
+  if (colon)
+    {
+      const char *subst_end = lindex (colon + 1, end, '=');
+
+      if (subst_end != 0)
+        {
+          struct exp_step *s = add_step (c, EXP_SUBST, beg, colon - beg);
+
+          s->u.subst.buf = xmalloc ((end - colon) + 3);
+          split_substitution (s->u.subst.buf, colon + 1, subst_end,
+                              subst_end + 1, end,
+                              &s->u.subst.pattern, &s->u.subst.replace,
+                              &s->u.subst.ppercent, &s->u.subst.rpercent);
+          return 1;
+        }
+    }
+
+  add_step (c, EXP_VARIABLE, beg, end - beg);
+  return 1;
+}
+
+/* Compile the text of C into its steps, scanning it just as
+   variable_expand_string does.  Return zero if it cannot be compiled.  */
+
+static int
+compile_steps (struct compiled_expansion *c)
+{
+  const char *p = c->text;
+
+  while (1)
+    {
+      const char *p1 = strchr (p, '$');
+
+      if (p1 == 0)
+        {
+          if (*p != '\0')
+            add_step (c, EXP_TEXT, p, strlen (p));
+          return 1;
+        }
+
+      if (p1 > p)
+        add_step (c, EXP_TEXT, p, p1 - p);
+      p = p1 + 1;
+
+      switch (*p)
+        {
+        case '$':
+        case '\0':
+          /* $$ or $ at the end of the string is one $.  */
+          add_step (c, EXP_TEXT, p1, 1);
+          break;
+
+        case '(':
+        case '{':
+          if (! compile_reference (c, &p))
+            return 0;
+          break;
+
+        default:
+          /* $a is equivalent to $(a).  */
+          add_step (c, EXP_VARIABLE, p, 1);
+          break;
+        }
+
+      if (*p == '\0')
+        return 1;
+
+      ++p;
+    }
+}
+
+/* Compile the LEN chars of TEXT.  */
+
+static struct compiled_expansion *
+compile_expansion (const char *text, unsigned int len)
+{
+  struct compiled_expansion *c;
+
+  c = xmalloc (sizeof (struct compiled_expansion) + len);
+  memcpy (c->text, text, len);
+  c->text[len] = '\0';
+  c->value = 0;
+  c->refs = 1;
+  c->functions = functions_defined;
+  c->nsteps = c->max = 0;
+  c->steps = 0;
+  c->interpret = 0;
+  c->memo = 0;
+  c->memo_deps = 0;
+  c->memo_ndeps = 0;
+
+  if (! compile_steps (c))
+    {
+      /* Keep only the text, as it was before steps were joined in it.  */
+      free_steps (c);
+      memcpy (c->text, text, len);
+      c->interpret = 1;
+    }
+
+  return c;
+}
+
+static char *allocated_expansion (struct compiled_expansion *c);
+
+/* Expand C, which is like expanding its text with variable_expand_string.
+   Write the result to O, which must point into 'variable_buffer', and
+   return the updated pointer into the buffer, as functions do.  */
+
+static char *
+expand_compiled (char *o, struct compiled_expansion *c)
+{
+  unsigned int i;
+
+  if (c->interpret)
+    {
+      o = variable_expand_string (o, c->text, -1);
+      return o + strlen (o);
+    }
+
+  STATS_COUNT (STATS_EXPANSIONS);
+
+  STATS_START (STATS_EXPAND);
+
+  for (i = 0; i < c->nsteps; ++i)
+    {
+      const struct exp_step *s = &c->steps[i];
+
+      switch (s->type)
+        {
+        case EXP_TEXT:
+          o = variable_buffer_output (o, s->text, s->len);
+          break;
+
+        case EXP_VARIABLE:
+          o = reference_variable (o, s->text, s->len);
+          break;
+
+        case EXP_SUBST:
+          o = substitute_reference (o, s->text, s->len,
+                                    s->u.subst.pattern, s->u.subst.replace,
+                                    s->u.subst.ppercent, s->u.subst.rpercent);
+          break;
+
+        case EXP_COMPUTED:
+          {
+            char *name = allocated_expansion (s->u.name);
+            o = expand_reference (o, name, name + strlen (name));
+            free (name);
+          }
+          break;
+
+        case EXP_CALL:
+          {
+            int nargs = s->u.call.nargs;
+            char **argv = alloca (sizeof (char *) * (nargs + 1));
+            char *text = 0;
+            int a;
+
+            /* Expand the arguments, or copy them if they are not to be
+               expanded.  */
+            if (s->u.call.expand)
+              for (a = 0; a < nargs; ++a)
+                argv[a] = (s->u.call.args[a]
+                           ? allocated_expansion (s->u.call.args[a])
+                           : xstrdup (""));
+            else
+              {
+                char *p = text = xmalloc (s->len);
+
+                memcpy (text, s->text, s->len);
+                for (a = 0; a < nargs; ++a)
+                  {
+                    argv[a] = p;
+                    p += strlen (p) + 1;
+                  }
+              }
+            argv[nargs] = 0;
+
+            o = expand_builtin_function (o, nargs, argv, s->u.call.entry_p);
+
+            if (s->u.call.expand)
+              for (a = 0; a < nargs; ++a)
+                free (argv[a]);
+            free (text);
+          }
+          break;
+        }
+    }
+
+  STATS_STOP (STATS_EXPAND);
+
+  return o;
+}
+
+/* Like allocated_variable_expand, but expand C.  */
+
+static char *
+allocated_expansion (struct compiled_expansion *c)
+{
+  char *value;
+
+  char *obuf = variable_buffer;
+  unsigned int olen = variable_buffer_length;
+
+  variable_buffer = 0;
+
+  value = expand_compiled (initialize_variable_output (), c);
+
+  /* variable_expand_string leaves two nulls at the end, and functions that
+     look for words past the first one depend on it.  */
+  variable_buffer_output (value, "\0", 2);
+  value = variable_buffer;
+
+  variable_buffer = obuf;
+  variable_buffer_length = olen;
+
+  return value;
+}
+
+/* Like allocated_variable_expand_for_file, but compile LINE into *CP the
+   first time, and expand the compiled line.  LINE must not be changed while
+   it is compiled in *CP.  */
+
+char *
+allocated_compiled_expand_for_file (struct compiled_expansion **cp,
+                                    const char *line, struct file *file)
+{
+  struct compiled_expansion *c = *cp;
+  struct variable_set_list *savev;
+  const gmk_floc *savef;
+  char *value;
+
+  if (c == 0 || c->value != line || c->functions != functions_defined)
+    {
+      if (c)
+        release_expansion (c);
+      c = *cp = compile_expansion (line, strlen (line));
+      c->value = line;
+      STATS_COUNT (STATS_COMPILED);
+    }
+
+  if (file == 0)
+    return allocated_expansion (c);
+
+  savev = current_variable_set_list;
+  current_variable_set_list = file->variables;
+
+  savef = reading_file;
+  if (file->cmds && file->cmds->fileinfo.filenm)
+    reading_file = &file->cmds->fileinfo;
+  else
+    reading_file = 0;
+
+  value = allocated_expansion (c);
+
+  current_variable_set_list = savev;
+  reading_file = savef;
+
+  return value;
+}
+
+/* Return nonzero if the memoized expansion of C is still good: no global
+   variable has changed, and each of its lookups finds the same variable.  */
+
+static int
+memo_valid (const struct compiled_expansion *c)
+{
+  unsigned int i;
+
+  if (c->memo_changes != global_variable_changes)
+    return 0;
+
+  for (i = 0; i < c->memo_ndeps; ++i)
+    if (lookup_variable (c->memo_deps[i].name, c->memo_deps[i].length)
+        != c->memo_deps[i].v)
+      return 0;
+
+  return 1;
+}
+
+/* Expand V->value, compiling it the first time, and expanding the compiled
+   value.  Write the result to O, which must point into 'variable_buffer', and
+   return the updated pointer into the buffer.  If the expansion can be
+   memoized, keep it, and copy it the next time if it is still good.  */
+
+static char *
+variable_value_output (char *o, struct variable *v)
+{
+  struct compiled_expansion *c = v->compiled;
+  struct memo_record record, *outer = memo_record;
+  unsigned long changes = global_variable_changes;
+  unsigned int offset;
+  unsigned int i;
+
+  if (c == 0 || c->value != v->value || c->functions != functions_defined)
+    {
+      forget_compiled_value (v);
+      c = v->compiled = compile_expansion (v->value, strlen (v->value));
+      c->value = v->value;
+      STATS_COUNT (STATS_COMPILED);
+    }
+
+  if (c->memo && memo_valid (c))
+    {
+      STATS_COUNT (STATS_MEMOIZED);
+
+      /* The expansion in progress depends on the same lookups.  */
+      if (outer)
+        for (i = 0; i < c->memo_ndeps; ++i)
+          record_lookup (outer, c->memo_deps[i].name, c->memo_deps[i].length,
+                         c->memo_deps[i].v);
+
+      return variable_buffer_output (o, c->memo, c->memo_len);
+    }
+
+  record.deps = 0;
+  record.ndeps = record.max = 0;
+  record.impure = 0;
+  memo_record = &record;
+
+  /* Expanding the value can redefine the variable.  The buffer can move
+     while it is expanded, so remember where the result starts.  */
+  ++c->refs;
+  offset = o - variable_buffer;
+  o = expand_compiled (o, c);
+
+  memo_record = outer;
+
+  if (outer)
+    {
+      if (record.impure)
+        outer->impure = 1;
+      else
+        for (i = 0; i < record.ndeps; ++i)
+          record_lookup (outer, record.deps[i].name, record.deps[i].length,
+                         record.deps[i].v);
+    }
+
+  /* Keep the expansion if nothing changed while it was done.  */
+  if (!record.impure && changes == global_variable_changes)
+    {
+      free (c->memo);
+      free (c->memo_deps);
+      c->memo_len = o - (variable_buffer + offset);
+      c->memo = xstrndup (variable_buffer + offset, c->memo_len);
+      c->memo_changes = changes;
+      c->memo_deps = record.deps;
+      c->memo_ndeps = record.ndeps;
+    }
+  else
+    free (record.deps);
+
+  release_expansion (c);
+
+  return o;
+}
+
 /* Expand LINE for FILE.  Error messages refer to the file and line where
    FILE's commands were found.  Expansion uses FILE's variable set list.  */
 
@@ -36,12 +36,25 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
    only work on files which have not yet been snapped. */
 int snapped_deps = 0;
 
-/* Hash table of files the makefile knows how to make.  */
+/* Hash table of files the makefile knows how to make.
+
+   The names of the files in it are in the strcache, so their hash is
+   already known and two of them are the same name only if they are the
+   same pointer.  So are the names enter_file, rehash_file and
+   lookup_cached_file look up.  The names lookup_file looks up may not be:
+   its keys have a null 'name'.  */
 
 static unsigned long
 file_hash_1 (const void *key)
 {
-  return_ISTRING_HASH_1 (((struct file const *) key)->hname);
+  struct file const *f = key;
+  unsigned long hash = 0;
+
+  if (f->name != 0)
+    return strcache_hash (f->hname);
+
+  ISTRING_HASH_1 (f->hname, hash);
+  return (unsigned int) hash;
 }
 
 static unsigned long
@@ -53,8 +66,12 @@ file_hash_2 (const void *key)
 static int
 file_hash_cmp (const void *x, const void *y)
 {
-  return_ISTRING_COMPARE (((struct file const *) x)->hname,
-                          ((struct file const *) y)->hname);
+  struct file const *fx = x;
+  struct file const *fy = y;
+
+  if (fx->name != 0 && fy->name != 0)
+    return fx->hname != fy->hname;
+  return_ISTRING_COMPARE (fx->hname, fy->hname);
 }
 
 #ifndef FILE_BUCKETS
@@ -62,6 +79,9 @@ file_hash_cmp (const void *x, const void *y)
 #endif
 static struct hash_table files;
 
+/* Where the 'struct file's are allocated from.  Files are never freed.  */
+struct arena file_arena = ARENA_INIT ("files", struct file);
+
 /* Whether or not .SECONDARY with no prerequisites was given.  */
 static int all_secondary = 0;
 
@@ -104,15 +124,32 @@ lookup_file (const char *name)
       /* It was all slashes after a dot.  */
       name = "./";
     }
+  file_key.name = 0;
   file_key.hname = name;
   f = hash_find_item (&files, &file_key);
 
   return f;
 }
 
+/* Like lookup_file, but NAME must be in the strcache and already have had
+   any leading "./" removed, as parse_file_seq does.  Its hash is then known
+   and only the pointer is compared, so no character of NAME is looked at.  */
+
+struct file *
+lookup_cached_file (const char *name)
+{
+  struct file file_key;
+
+  assert (*name != '\0');
+  assert (! verify_flag || strcache_iscached (name));
+
+  file_key.name = file_key.hname = name;
+  return hash_find_item (&files, &file_key);
+}
+
 /* Look up a file record for file NAME and return it.
    Create a new record if one doesn't exist.  NAME will be stored in the
-   new record so it should be constant or in the strcache etc.
+   new record so it must be in the strcache.
  */
 
 struct file *
@@ -127,7 +164,7 @@ enter_file (const char *name)
   assert (! verify_flag || strcache_iscached (name));
 
 
-  file_key.hname = name;
+  file_key.name = file_key.hname = name;
   file_slot = (struct file **) hash_find_slot (&files, &file_key);
   f = *file_slot;
   if (! HASH_VACANT (f) && !f->double_colon)
@@ -136,7 +173,7 @@ enter_file (const char *name)
       return f;
     }
 
-  new = xcalloc (sizeof (struct file));
+  new = arena_alloc (&file_arena);
   new->name = new->hname = name;
   new->update_status = us_none;
 
@@ -169,9 +206,11 @@ rehash_file (struct file *from_file, const char *to_hname)
   struct file *deleted_file;
   struct file *f;
 
+  assert (! verify_flag || strcache_iscached (to_hname));
+
   /* If it's already that name, we're done.  */
   from_file->builtin = 0;
-  file_key.hname = to_hname;
+  file_key.name = file_key.hname = to_hname;
   if (! file_hash_cmp (from_file, &file_key))
     return;
 
@@ -303,16 +342,87 @@ rename_file (struct file *from_file, const char *to_hname)
     }
 }
 
+/* Nonzero if F is an intermediate file to be deleted when make is done:
+   if it's marked intermediate, it's not secondary, it wasn't given on the
+   command line, and it's either a -include makefile or it's not precious.  */
+
+#define REMOVABLE_INTERMEDIATE(f) \
+  ((f)->intermediate && ((f)->dontcare || !(f)->precious) \
+   && !(f)->secondary && !(f)->cmd_target)
+
+/* Remove the intermediate file F, if something created it, as described
+   below for remove_intermediates.  DONEANY is nonzero if an "rm" line has
+   already been started; return whether one has now.  */
+
+static int
+remove_intermediate (struct file *f, int sig, int doneany)
+{
+  int status;
+
+  if (f->update_status == us_none)
+    /* If nothing would have created this file yet,
+       don't print an "rm" command for it.  */
+    return doneany;
+  if (just_print_flag)
+    status = 0;
+  else
+    {
+      status = unlink (f->name);
+      if (status < 0 && errno == ENOENT)
+        return doneany;
+    }
+  if (!f->dontcare)
+    {
+      if (sig)
+        OS (error, NILF,
+            _("*** Deleting intermediate file '%s'"), f->name);
+      else
+        {
+          if (! doneany)
+            DB (DB_BASIC, (_("Removing intermediate files...\n")));
+          if (!silent_flag)
+            {
+              if (! doneany)
+                {
+                  fputs ("rm ", stdout);
+                  doneany = 1;
+                }
+              else
+                putchar (' ');
+              fputs (f->name, stdout);
+              fflush (stdout);
+            }
+        }
+      if (status < 0)
+        perror_with_name ("unlink: ", f->name);
+    }
+
+  return doneany;
+}
+
+static int
+file_name_cmp (const void *x, const void *y)
+{
+  return strcmp ((*(struct file *const *) x)->name,
+                 (*(struct file *const *) y)->name);
+}
+
 /* Remove all nonprecious intermediate files.
    If SIG is nonzero, this was caused by a fatal signal,
    meaning that a different message will be printed, and
-   the message will go to stderr rather than stdout.  */
+   the message will go to stderr rather than stdout.
+
+   Otherwise the files are removed in order of their names, so that the
+   "rm" line does not depend on the layout of the files hash table.  */
 
 void
 remove_intermediates (int sig)
 {
   struct file **file_slot;
   struct file **file_end;
+  struct file **removable;
+  unsigned long n = 0;
+  unsigned long i;
   int doneany = 0;
 
   /* If there's no way we will ever remove anything anyway, punt early.  */
@@ -324,59 +434,35 @@ remove_intermediates (int sig)
 
   file_slot = (struct file **) files.ht_vec;
   file_end = file_slot + files.ht_size;
+
+  if (sig)
+    {
+      /* Don't allocate memory in a signal handler.  */
+      for ( ; file_slot < file_end; file_slot++)
+        if (! HASH_VACANT (*file_slot) && REMOVABLE_INTERMEDIATE (*file_slot))
+          remove_intermediate (*file_slot, sig, 0);
+      return;
+    }
+
   for ( ; file_slot < file_end; file_slot++)
-    if (! HASH_VACANT (*file_slot))
-      {
-        struct file *f = *file_slot;
-        /* Is this file eligible for automatic deletion?
-           Yes, IFF: it's marked intermediate, it's not secondary, it wasn't
-           given on the command line, and it's either a -include makefile or
-           it's not precious.  */
-        if (f->intermediate && (f->dontcare || !f->precious)
-            && !f->secondary && !f->cmd_target)
-          {
-            int status;
-            if (f->update_status == us_none)
-              /* If nothing would have created this file yet,
-                 don't print an "rm" command for it.  */
-              continue;
-            if (just_print_flag)
-              status = 0;
-            else
-              {
-                status = unlink (f->name);
-                if (status < 0 && errno == ENOENT)
-                  continue;
-              }
-            if (!f->dontcare)
-              {
-                if (sig)
-                  OS (error, NILF,
-                      _("*** Deleting intermediate file '%s'"), f->name);
-                else
-                  {
-                    if (! doneany)
-                      DB (DB_BASIC, (_("Removing intermediate files...\n")));
-                    if (!silent_flag)
-                      {
-                        if (! doneany)
-                          {
-                            fputs ("rm ", stdout);
-                            doneany = 1;
-                          }
-                        else
-                          putchar (' ');
-                        fputs (f->name, stdout);
-                        fflush (stdout);
-                      }
-                  }
-                if (status < 0)
-                  perror_with_name ("unlink: ", f->name);
-              }
-          }
-      }
+    if (! HASH_VACANT (*file_slot) && REMOVABLE_INTERMEDIATE (*file_slot))
+      ++n;
+  if (n == 0)
+    return;
+
+  removable = xmalloc (n * sizeof (struct file *));
+  n = 0;
+  for (file_slot = (struct file **) files.ht_vec; file_slot < file_end;
+       file_slot++)
+    if (! HASH_VACANT (*file_slot) && REMOVABLE_INTERMEDIATE (*file_slot))
+      removable[n++] = *file_slot;
+  qsort (removable, n, sizeof (struct file *), file_name_cmp);
+
+  for (i = 0; i < n; ++i)
+    doneany = remove_intermediate (removable[i], 0, doneany);
+  free (removable);
 
-  if (doneany && !sig)
+  if (doneany)
     {
       putchar ('\n');
       fflush (stdout);
@@ -487,7 +573,7 @@ enter_prereqs (struct dep *deps, const char *stem)
       if (d1->need_2nd_expansion)
         continue;
 
-      d1->file = lookup_file (d1->name);
+      d1->file = lookup_cached_file (d1->name);
       if (d1->file == 0)
         d1->file = enter_file (d1->name);
       d1->staticpattern = 0;
@@ -600,6 +686,53 @@ reset_updating (const void *item)
   f->updating = 0;
 }
 
+/* Lay out the prerequisites of the file ITEM one after another in memory,
+   if they are not already.  After snap_deps the graph hardly changes, but it
+   is walked again and again while updating; a list whose elements were
+   allocated at different times, as when a target's prerequisites come from
+   several rules or second expansion, is scattered around the heap.  The
+   list is kept as a list, with each element's 'next' pointing at the one
+   after it, so prerequisites that implicit rule search adds later are
+   simply chained onto the end.  */
+
+static void
+compact_file_deps (const void *item)
+{
+  struct file *f;
+
+  for (f = (struct file *) item; f != 0; f = f->prev)
+    {
+      struct dep *d, *next, *array;
+      unsigned int n = 0;
+      int contiguous = 1;
+
+      for (d = f->deps; d != 0; d = d->next)
+        {
+          if (d->next != 0 && d->next != d + 1)
+            contiguous = 0;
+          ++n;
+        }
+      if (contiguous)
+        continue;
+
+      /* ARRAY is indexed as 'struct dep' below.  */
+      assert (dep_arena.size == sizeof (struct dep));
+      array = arena_alloc_array (&dep_arena, n);
+      if (array == 0)
+        return;
+
+      for (d = f->deps, n = 0; d != 0; d = next, ++n)
+        {
+          next = d->next;
+          array[n] = *d;
+          array[n].next = next ? &array[n + 1] : 0;
+          free_dep (d);
+        }
+      f->deps = array;
+      STATS_COUNT (STATS_COMPACTED);
+    }
+}
+
 /* For each dependency of each file, make the 'struct dep' point
    at the appropriate 'struct file' (which may have to be created).
 
@@ -617,6 +750,8 @@ snap_deps (void)
      longer define new targets.  */
   snapped_deps = 1;
 
+  trace_begin ("phase", "snap_deps", 0);
+
   /* Perform second expansion and enter each dependency name as a file.  We
      must use hash_dump() here because within these loops we likely add new
      files to the table, possibly causing an in-situ table expansion.
@@ -733,6 +868,12 @@ snap_deps (void)
     define_variable_cname ("OUTPUT_OPTION", "", o_default, 1);
   */
 #endif
+
+  /* The graph is complete, but for implicit rules: make it quick to walk.  */
+  if (compact_deps_flag)
+    hash_map (&files, compact_file_deps);
+
+  trace_end (0);
 }
 
 /* Set the 'command_state' member of FILE and all its 'also_make's.  */
@@ -1002,6 +1143,14 @@ print_file_data_base (void)
   fputs (_("\n# files hash-table stats:\n# "), stdout);
   hash_print_stats (&files, stdout);
 }
+
+/* Print the hash table statistics for --stats.  */
+
+void
+print_file_stats (void)
+{
+  stats_print_hash (_("files"), &files);
+}
 
 /* Verify the integrity of the data base of files.  */
 
@@ -23,42 +23,32 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 struct file
   {
-    const char *name;
-    const char *hname;          /* Hashed filename */
-    const char *vpath;          /* VPATH/vpath pathname */
-    struct dep *deps;           /* all dependencies, including duplicates */
-    struct commands *cmds;      /* Commands to execute for this target.  */
-    const char *stem;           /* Implicit stem, if an implicit
-                                   rule has been used */
-    struct dep *also_make;      /* Targets that are made by making this.  */
-    struct file *prev;          /* Previous entry for same file name;
-                                   used when there are multiple double-colon
-                                   entries for the same file.  */
-    struct file *last;          /* Last entry for the same file name.  */
+    /* The members read or written each time the file is reached while
+       updating the goals come first, in the first 64 bytes, so that on the
+       many visits that find it already considered the walk touches as few
+       cache lines as possible.  The rest are used when the file is first
+       considered, when its recipe runs, or when reading makefiles.  */
 
     /* File that this file was renamed to.  After any time that a
        file could be renamed, call 'check_renamed' (below).  */
     struct file *renamed;
 
-    /* List of variable sets used for this file.  */
-    struct variable_set_list *variables;
+    /* For a double-colon entry, this is the first double-colon entry for
+       the same file.  Otherwise this is null.  */
+    struct file *double_colon;
 
-    /* Pattern-specific variable reference for this target, or null if there
-       isn't one.  Also see the pat_searched flag, below.  */
-    struct variable_set_list *pat_variables;
+    struct file *prev;          /* Previous entry for same file name;
+                                   used when there are multiple double-colon
+                                   entries for the same file.  */
 
     /* Immediate dependent that caused this target to be remade,
        or nil if there isn't one.  */
     struct file *parent;
 
-    /* For a double-colon entry, this is the first double-colon entry for
-       the same file.  Otherwise this is null.  */
-    struct file *double_colon;
-
     FILE_TIMESTAMP last_mtime;  /* File's modtime, if already known.  */
-    FILE_TIMESTAMP mtime_before_update; /* File's modtime before any updating
-                                           has been performed.  */
-    int command_flags;          /* Flags OR'd in for cmds; see commands.h.  */
+    struct dep *deps;           /* all dependencies, including duplicates */
+    struct commands *cmds;      /* Commands to execute for this target.  */
+    unsigned int pending;       /* Number of prerequisites waited for.  */
     enum update_status          /* Status of the last attempt to update.  */
       {
         us_success = 0,         /* Successfully updated.  Must be 0!  */
@@ -100,6 +90,33 @@ struct file
                                    considered on current scan of goal chain */
     unsigned int no_diag:1;     /* True if the file failed to update and no
                                    diagnostics has been issued (dontcare). */
+    unsigned int wait_through:1;/* Nonzero if this intermediate file waits
+                                   only on behalf of its dependents.  */
+    unsigned int ready:1;       /* Nonzero if on the list of files to be
+                                   considered again.  */
+
+    const char *name;
+    const char *hname;          /* Hashed filename */
+    const char *vpath;          /* VPATH/vpath pathname */
+    const char *stem;           /* Implicit stem, if an implicit
+                                   rule has been used */
+    struct dep *also_make;      /* Targets that are made by making this.  */
+    struct file *last;          /* Last entry for the same file name.  */
+
+    /* List of variable sets used for this file.  */
+    struct variable_set_list *variables;
+
+    /* Pattern-specific variable reference for this target, or null if there
+       isn't one.  Also see the pat_searched flag, above.  */
+    struct variable_set_list *pat_variables;
+
+    /* Files waiting for this one to finish being made.  */
+    struct dep *waiters;
+
+    FILE_TIMESTAMP mtime_before_update; /* File's modtime before any updating
+                                           has been performed.  */
+    int command_flags;          /* Flags OR'd in for cmds; see commands.h.  */
+    unsigned int wait_depth;    /* Depth this file was last considered at.  */
   };
 
 
@@ -107,6 +124,7 @@ extern struct file *suffix_file, *default_file;
 
 
 struct file *lookup_file (const char *name);
+struct file *lookup_cached_file (const char *name);
 struct file *enter_file (const char *name);
 struct dep *split_prereqs (char *prereqstr);
 struct dep *enter_prereqs (struct dep *prereqs, const char *stem);
@@ -120,10 +138,27 @@ void init_hash_files (void);
 char *build_target_list (char *old_list);
 void print_prereqs (const struct dep *deps);
 void print_file_data_base (void);
+void print_file_stats (void);
+extern struct arena file_arena;
+void prefetch_mtimes (struct dep *goals);
+void prefetch_name (const char *name, unsigned int length);
+int prefetched_stat (const char *name, struct stat *st, FILE_TIMESTAMP *mtimep,
+                     int *resultp);
+void prefetch_finish (void);
+void schedule_load (const char *file);
+unsigned long schedule_clock (void);
+unsigned long schedule_priority (const struct file *file);
+void schedule_record (const struct file *file, unsigned long msecs);
+void schedule_save (const char *file, struct dep *goals);
 
 #define FILE_TIMESTAMP_HI_RES 1
-#define FILE_TIMESTAMP_STAT_MODTIME(fname, st) \
-    file_timestamp_cons (fname, (st).st_mtim.tv_sec, (st).st_mtim.tv_nsec)
+#ifdef ST_MTIM_NSEC
+# define FILE_TIMESTAMP_STAT_MODTIME(fname, st) \
+    file_timestamp_cons (fname, (st).st_mtime, (st).ST_MTIM_NSEC)
+#else
+# define FILE_TIMESTAMP_STAT_MODTIME(fname, st) \
+    file_timestamp_cons (fname, (st).st_mtime, 0)
+#endif
 
 /* If FILE_TIMESTAMP is 64 bits (or more), use nanosecond resolution.
    (Multiply by 2**30 instead of by 10**9 to save time at the cost of
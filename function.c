@@ -35,6 +35,7 @@ struct function_table_entry
     unsigned char maximum_args;
     unsigned char expand_args:1;
     unsigned char alloc_fn:1;
+    unsigned char pure:1;
   };
 
 static unsigned long
@@ -382,7 +383,7 @@ string_glob (char *line)
 
       /* Because we used PARSEFS_NOCACHE above, we have to free() NAME.  */
       free ((char *)chain->name);
-      free (chain);
+      free_ns (chain);
       chain = next;
     }
 
@@ -818,17 +819,15 @@ func_foreach (char *o, char **argv, const char *funcname UNUSED)
   /* loop through LIST,  put the value in VAR and expand BODY */
   while ((p = find_next_token (&list_iterator, &len)) != 0)
     {
-      char *result = 0;
-
+      forget_compiled_value (var);
       free (var->value);
       var->value = xstrndup (p, len);
 
-      result = allocated_variable_expand (body);
-
-      o = variable_buffer_output (o, result, strlen (result));
+      /* Expand BODY where its result goes.  */
+      o = variable_expand_string (o, body, -1);
+      o += strlen (o);
       o = variable_buffer_output (o, " ", 1);
       doneany = 1;
-      free (result);
     }
 
   if (doneany)
@@ -842,62 +841,151 @@ func_foreach (char *o, char **argv, const char *funcname UNUSED)
   return o;
 }
 
-struct a_word
+/* A pattern of $(filter) or $(filter-out).  A word matches it if it starts
+   with PREFIX and ends with SUFFIX, or if it is PREFIX when there is no
+   percent and SUFFIX is null.  */
+
+struct a_pattern
 {
-  struct a_word *next;
-  struct a_word *chain;
-  char *str;
-  int length;
-  int matched;
+  const char *prefix;
+  const char *suffix;
+  unsigned int plen;
+  unsigned int slen;
 };
 
+/* With this many patterns or more, they are put in a hash table, so that
+   each word is looked up rather than compared with every pattern.  */
+#define FILTER_INDEX_PATTERNS 4
+
 static unsigned long
-a_word_hash_1 (const void *key)
+a_pattern_hash_1 (const void *key)
 {
-  return_STRING_HASH_1 (((struct a_word const *) key)->str);
+  const struct a_pattern *pat = key;
+  unsigned long result = pat->suffix ? 0 : 1;
+
+  STRING_N_HASH_1 (pat->prefix, pat->plen, result);
+  if (pat->suffix)
+    STRING_N_HASH_1 (pat->suffix, pat->slen, result);
+  return result;
 }
 
 static unsigned long
-a_word_hash_2 (const void *key)
+a_pattern_hash_2 (const void *key)
 {
-  return_STRING_HASH_2 (((struct a_word const *) key)->str);
+  const struct a_pattern *pat = key;
+  unsigned long result = pat->plen;
+
+  if (pat->plen)
+    STRING_N_HASH_2 (pat->prefix, pat->plen, result);
+  if (pat->slen)
+    STRING_N_HASH_2 (pat->suffix, pat->slen, result);
+  return result;
 }
 
 static int
-a_word_hash_cmp (const void *x, const void *y)
+a_pattern_hash_cmp (const void *x, const void *y)
 {
-  int result = ((struct a_word const *) x)->length - ((struct a_word const *) y)->length;
+  const struct a_pattern *px = x;
+  const struct a_pattern *py = y;
+  int result;
+
+  result = (px->suffix != 0) - (py->suffix != 0);
   if (result)
     return result;
-  return_STRING_COMPARE (((struct a_word const *) x)->str,
-                         ((struct a_word const *) y)->str);
+  result = px->plen - py->plen;
+  if (result)
+    return result;
+  result = px->slen - py->slen;
+  if (result)
+    return result;
+  result = memcmp (px->prefix, py->prefix, px->plen);
+  if (result || px->slen == 0)
+    return result;
+  return memcmp (px->suffix, py->suffix, px->slen);
 }
 
-struct a_pattern
+/* The lengths of the prefix and suffix of some percent patterns.  */
+
+struct a_pattern_group
 {
-  struct a_pattern *next;
-  char *str;
-  char *percent;
-  int length;
+  unsigned int plen;
+  unsigned int slen;
 };
 
+static int
+a_pattern_group_cmp (const void *x, const void *y)
+{
+  const struct a_pattern_group *gx = x;
+  const struct a_pattern_group *gy = y;
+
+  if (gx->plen != gy->plen)
+    return gx->plen < gy->plen ? -1 : 1;
+  if (gx->slen != gy->slen)
+    return gx->slen < gy->slen ? -1 : 1;
+  return 0;
+}
+
+/* Return nonzero if the LEN chars at WORD match PAT.  */
+
+static int
+a_pattern_matches (const struct a_pattern *pat, const char *word,
+                   unsigned int len)
+{
+  if (pat->suffix == 0)
+    return len == pat->plen && memcmp (word, pat->prefix, len) == 0;
+
+  return (len >= pat->plen + pat->slen
+          && memcmp (word, pat->prefix, pat->plen) == 0
+          && memcmp (word + len - pat->slen, pat->suffix, pat->slen) == 0);
+}
+
+/* Return nonzero if the LEN chars at WORD match a pattern in TABLE: the
+   word itself as a literal pattern, or its first and last chars as the
+   prefix and suffix of a percent pattern in one of the NGROUPS GROUPS.  */
+
+static int
+a_pattern_lookup (struct hash_table *table,
+                  const struct a_pattern_group *groups, unsigned int ngroups,
+                  const char *word, unsigned int len)
+{
+  struct a_pattern key;
+  unsigned int i;
+
+  key.prefix = word;
+  key.plen = len;
+  key.suffix = 0;
+  key.slen = 0;
+  if (hash_find_item (table, &key))
+    return 1;
+
+  for (i = 0; i < ngroups && groups[i].plen <= len; ++i)
+    if (groups[i].plen + groups[i].slen <= len)
+      {
+        key.plen = groups[i].plen;
+        key.slen = groups[i].slen;
+        key.suffix = word + len - key.slen;
+        if (hash_find_item (table, &key))
+          return 1;
+      }
+
+  return 0;
+}
+
 static char *
 func_filter_filterout (char *o, char **argv, const char *funcname)
 {
-  struct a_word *wordhead;
-  struct a_word **wordtail;
-  struct a_word *wp;
-  struct a_pattern *pathead;
-  struct a_pattern **pattail;
-  struct a_pattern *pp;
-
-  struct hash_table a_word_table;
+  struct a_pattern *pats = 0;
+  unsigned int npats = 0;
+  unsigned int maxpats = 0;
+  struct a_pattern_group *groups = 0;
+  unsigned int ngroups = 0;
+  struct hash_table a_pattern_table;
   int is_filter = funcname[CSTRLEN ("filter")] == '\0';
   const char *pat_iterator = argv[0];
   const char *word_iterator = argv[1];
-  int literals = 0;
-  int words = 0;
-  int hashing = 0;
+  int hashing;
+  int doneany = 0;
+  unsigned int i;
   char *p;
   unsigned int len;
 
@@ -905,108 +993,105 @@ func_filter_filterout (char *o, char **argv, const char *funcname)
      We don't need to preserve it because our caller frees all the
      argument memory anyway.  */
 
-  pattail = &pathead;
   while ((p = find_next_token (&pat_iterator, &len)) != 0)
     {
-      struct a_pattern *pat = alloca (sizeof (struct a_pattern));
-
-      *pattail = pat;
-      pattail = &pat->next;
+      struct a_pattern *pat;
+      char *percent;
 
       if (*pat_iterator != '\0')
         ++pat_iterator;
 
-      pat->str = p;
-      p[len] = '\0';
-      pat->percent = find_percent (p);
-      if (pat->percent == 0)
-        literals++;
-
-      /* find_percent() might shorten the string so LEN is wrong.  */
-      pat->length = strlen (pat->str);
-    }
-  *pattail = 0;
-
-  /* Chop ARGV[1] up into words to match against the patterns.  */
-
-  wordtail = &wordhead;
-  while ((p = find_next_token (&word_iterator, &len)) != 0)
-    {
-      struct a_word *word = alloca (sizeof (struct a_word));
-
-      *wordtail = word;
-      wordtail = &word->next;
-
-      if (*word_iterator != '\0')
-        ++word_iterator;
+      if (npats == maxpats)
+        {
+          maxpats = maxpats ? 2 * maxpats : 16;
+          pats = xrealloc (pats, maxpats * sizeof (struct a_pattern));
+        }
+      pat = &pats[npats++];
 
       p[len] = '\0';
-      word->str = p;
-      word->length = len;
-      word->matched = 0;
-      word->chain = 0;
-      words++;
-    }
-  *wordtail = 0;
+      percent = find_percent (p);
 
-  /* Only use a hash table if arg list lengths justifies the cost.  */
-  hashing = (literals >= 2 && (literals * words) >= 10);
-  if (hashing)
-    {
-      hash_init (&a_word_table, words, a_word_hash_1, a_word_hash_2,
-                 a_word_hash_cmp);
-      for (wp = wordhead; wp != 0; wp = wp->next)
+      /* find_percent() might shorten the string so LEN is wrong.  */
+      pat->prefix = p;
+      if (percent == 0)
+        {
+          pat->plen = strlen (p);
+          pat->suffix = 0;
+          pat->slen = 0;
+        }
+      else
         {
-          struct a_word *owp = hash_insert (&a_word_table, wp);
-          if (owp)
-            wp->chain = owp;
+          pat->plen = percent - p;
+          pat->suffix = percent + 1;
+          pat->slen = strlen (percent + 1);
         }
     }
 
-  if (words)
+  /* With enough patterns, put them all in a hash table, and note each
+     different length of prefix and suffix of the percent patterns: a word
+     is then looked up once as a literal, and once for each of those.  */
+  hashing = npats >= FILTER_INDEX_PATTERNS;
+  if (hashing)
     {
-      int doneany = 0;
-
-      /* Run each pattern through the words, killing words.  */
-      for (pp = pathead; pp != 0; pp = pp->next)
+      hash_init (&a_pattern_table, npats, a_pattern_hash_1, a_pattern_hash_2,
+                 a_pattern_hash_cmp);
+      groups = xmalloc (npats * sizeof (struct a_pattern_group));
+      for (i = 0; i < npats; ++i)
         {
-          if (pp->percent)
-            for (wp = wordhead; wp != 0; wp = wp->next)
-              wp->matched |= pattern_matches (pp->str, pp->percent, wp->str);
-          else if (hashing)
+          hash_insert (&a_pattern_table, &pats[i]);
+          if (pats[i].suffix)
             {
-              struct a_word a_word_key;
-              a_word_key.str = pp->str;
-              a_word_key.length = pp->length;
-              wp = hash_find_item (&a_word_table, &a_word_key);
-              while (wp)
-                {
-                  wp->matched |= 1;
-                  wp = wp->chain;
-                }
+              groups[ngroups].plen = pats[i].plen;
+              groups[ngroups].slen = pats[i].slen;
+              ++ngroups;
             }
-          else
-            for (wp = wordhead; wp != 0; wp = wp->next)
-              wp->matched |= (wp->length == pp->length
-                              && strneq (pp->str, wp->str, wp->length));
         }
 
-      /* Output the words that matched (or didn't, for filter-out).  */
-      for (wp = wordhead; wp != 0; wp = wp->next)
-        if (is_filter ? wp->matched : !wp->matched)
+      /* Keep one of each group, shortest prefix first.  */
+      if (ngroups > 1)
+        {
+          unsigned int n = 1;
+
+          qsort (groups, ngroups, sizeof (struct a_pattern_group),
+                 a_pattern_group_cmp);
+          for (i = 1; i < ngroups; ++i)
+            if (a_pattern_group_cmp (&groups[i], &groups[n - 1]) != 0)
+              groups[n++] = groups[i];
+          ngroups = n;
+        }
+    }
+
+  /* Output the words that matched (or didn't, for filter-out).  */
+  if (npats || !is_filter)
+    while ((p = find_next_token (&word_iterator, &len)) != 0)
+      {
+        int matched = 0;
+
+        if (hashing)
+          matched = a_pattern_lookup (&a_pattern_table, groups, ngroups,
+                                      p, len);
+        else
+          for (i = 0; i < npats && !matched; ++i)
+            matched = a_pattern_matches (&pats[i], p, len);
+
+        if (is_filter ? matched : !matched)
           {
-            o = variable_buffer_output (o, wp->str, strlen (wp->str));
+            o = variable_buffer_output (o, p, len);
             o = variable_buffer_output (o, " ", 1);
             doneany = 1;
           }
+      }
 
-      if (doneany)
-        /* Kill the last space.  */
-        --o;
-    }
+  if (doneany)
+    /* Kill the last space.  */
+    --o;
 
   if (hashing)
-    hash_free (&a_word_table, 0);
+    {
+      hash_free (&a_pattern_table, 0);
+      free (groups);
+    }
+  free (pats);
 
   return o;
 }
@@ -1194,11 +1279,8 @@ func_if (char *o, char **argv, const char *funcname UNUSED)
 
   if (*argv)
     {
-      char *expansion = expand_argument (*argv, NULL);
-
-      o = variable_buffer_output (o, expansion, strlen (expansion));
-
-      free (expansion);
+      o = variable_expand_string (o, *argv, -1);
+      o += strlen (o);
     }
 
   return o;
@@ -1391,12 +1473,16 @@ fold_newlines (char *buffer, unsigned int *length, int trim_newlines)
 pid_t shell_function_pid = 0;
 static int shell_function_completed;
 
+/* Exit status of the last shell function, or -1 if it didn't exit.  */
+static int shell_function_status;
+
 void
 shell_completed (int exit_code, int exit_sig)
 {
   char buf[256];
 
   shell_function_pid = 0;
+  shell_function_status = exit_sig == 0 ? exit_code : -1;
   if (exit_sig == 0 && exit_code == 127)
     shell_function_completed = -1;
   else
@@ -1566,6 +1652,8 @@ func_shell_base (char *o, char **argv, int trim_newlines)
   just_print_flag = 0;
 #endif
 
+  STATS_COUNT (STATS_SHELLS);
+
   /* Construct the argument list.  */
   command_argv = construct_command_argv (argv[0], NULL, NULL, 0,
                                          &batch_filename);
@@ -1607,6 +1695,35 @@ func_shell_base (char *o, char **argv, int trim_newlines)
   errfd = (output_context && output_context->err >= 0
            ? output_context->err : FD_STDERR);
 
+  /* Use a running shell if we can.  */
+  if (errfd == FD_STDERR)
+    {
+      char *buffer;
+      unsigned int len;
+      int status, sig;
+
+      if (shell_pool_run (command_argv, &status, &sig, &buffer, &len))
+        {
+          free (command_argv[0]);
+          free (command_argv);
+
+          shell_completed (status, sig);
+          if (shell_function_completed == -1)
+            {
+              fputs (buffer, stderr);
+              fflush (stderr);
+            }
+          else
+            {
+              fold_newlines (buffer, &len, trim_newlines);
+              o = variable_buffer_output (o, buffer, len);
+            }
+
+          free (buffer);
+          return o;
+        }
+    }
+
 #if   defined(WINDOWS32)
   windows32_openpipe (pipedes, errfd, &pid, command_argv, envp);
   /* Restore the value of just_print_flag.  */
@@ -1627,7 +1744,11 @@ func_shell_base (char *o, char **argv, int trim_newlines)
       return o;
     }
 
-  pid = fork ();
+  STATS_START (STATS_SPAWN);
+  pid = child_spawn_job (FD_STDIN, pipedes[1], errfd, command_argv, envp, 0);
+  if (pid < 0)
+    pid = fork ();
+  STATS_STOP (STATS_SPAWN);
   if (pid < 0)
     perror_with_name (error_prefix, "fork");
   else if (pid == 0)
@@ -1730,6 +1851,60 @@ func_shell (char *o, char **argv, const char *funcname UNUSED)
   return func_shell_base (o, argv, 1);
 }
 
+/* $(cached-shell FILES,COMMAND) is $(shell COMMAND), with the output
+   remembered across runs for as long as FILES don't change.  */
+
+static char *
+func_cached_shell (char *o, char **argv, const char *funcname UNUSED)
+{
+  char *key;
+  unsigned int key_len, len;
+  unsigned long offset;
+  const char *output;
+  char **command_argv;
+  char *batch_filename = NULL;
+
+  /* The output also depends on the shell and flags COMMAND is run with.
+     Don't cache commands run from a batch file: its name is new each time.  */
+  command_argv = construct_command_argv (argv[1], NULL, NULL, 0,
+                                         &batch_filename);
+  if (command_argv == 0)
+    return o;
+  if (batch_filename)
+    {
+      remove (batch_filename);
+      free (batch_filename);
+      key = 0;
+    }
+  else
+    key = shellcache_key (argv[0], command_argv, &key_len);
+  free (command_argv[0]);
+  free (command_argv);
+
+  if (key == 0)
+    return func_shell_base (o, &argv[1], 1);
+
+  output = shellcache_lookup (argv[1], key, key_len, &len);
+  if (output)
+    {
+      shell_completed (0, 0);
+      free (key);
+      return variable_buffer_output (o, output, len);
+    }
+
+  /* The variable buffer may move, so remember where the output starts.  */
+  offset = o - variable_buffer;
+  shell_function_status = -1;
+  o = func_shell_base (o, &argv[1], 1);
+
+  if (shell_function_status == 0)
+    shellcache_store (argv[1], key, key_len, variable_buffer + offset,
+                      o - (variable_buffer + offset));
+
+  free (key);
+  return o;
+}
+
 #ifdef EXPERIMENTAL
 
 /*
@@ -1981,69 +2156,82 @@ func_abspath (char *o, char **argv, const char *funcname UNUSED)
    comma-separated values are treated as arguments.
 
    EXPAND_ARGS means that all arguments should be expanded before invocation.
-   Functions that do namespace tricks (foreach) don't automatically expand.  */
+   Functions that do namespace tricks (foreach) don't automatically expand.
+
+   PURE means that the result depends only on the arguments, and calling the
+   function does nothing else, so an expansion that calls it may be
+   memoized.  */
 
 static char *func_call (char *o, char **argv, const char *funcname);
 
-#define FT_ENTRY(_name, _min, _max, _exp, _func) \
-  { { (_func) }, STRING_SIZE_TUPLE(_name), (_min), (_max), (_exp), 0 }
+#define FT_ENTRY(_name, _min, _max, _exp, _pure, _func) \
+  { { (_func) }, STRING_SIZE_TUPLE(_name), (_min), (_max), (_exp), 0, (_pure) }
 
 static struct function_table_entry function_table_init[] =
 {
- /*         Name            MIN MAX EXP? Function */
-  FT_ENTRY ("abspath",       0,  1,  1,  func_abspath),
-  FT_ENTRY ("addprefix",     2,  2,  1,  func_addsuffix_addprefix),
-  FT_ENTRY ("addsuffix",     2,  2,  1,  func_addsuffix_addprefix),
-  FT_ENTRY ("basename",      0,  1,  1,  func_basename_dir),
-  FT_ENTRY ("dir",           0,  1,  1,  func_basename_dir),
-  FT_ENTRY ("notdir",        0,  1,  1,  func_notdir_suffix),
-  FT_ENTRY ("subst",         3,  3,  1,  func_subst),
-  FT_ENTRY ("suffix",        0,  1,  1,  func_notdir_suffix),
-  FT_ENTRY ("filter",        2,  2,  1,  func_filter_filterout),
-  FT_ENTRY ("filter-out",    2,  2,  1,  func_filter_filterout),
-  FT_ENTRY ("findstring",    2,  2,  1,  func_findstring),
-  FT_ENTRY ("firstword",     0,  1,  1,  func_firstword),
-  FT_ENTRY ("flavor",        0,  1,  1,  func_flavor),
-  FT_ENTRY ("join",          2,  2,  1,  func_join),
-  FT_ENTRY ("lastword",      0,  1,  1,  func_lastword),
-  FT_ENTRY ("patsubst",      3,  3,  1,  func_patsubst),
-  FT_ENTRY ("realpath",      0,  1,  1,  func_realpath),
-  FT_ENTRY ("shell",         0,  1,  1,  func_shell),
-  FT_ENTRY ("sort",          0,  1,  1,  func_sort),
-  FT_ENTRY ("strip",         0,  1,  1,  func_strip),
-  FT_ENTRY ("wildcard",      0,  1,  1,  func_wildcard),
-  FT_ENTRY ("word",          2,  2,  1,  func_word),
-  FT_ENTRY ("wordlist",      3,  3,  1,  func_wordlist),
-  FT_ENTRY ("words",         0,  1,  1,  func_words),
-  FT_ENTRY ("origin",        0,  1,  1,  func_origin),
-  FT_ENTRY ("foreach",       3,  3,  0,  func_foreach),
-  FT_ENTRY ("call",          1,  0,  1,  func_call),
-  FT_ENTRY ("info",          0,  1,  1,  func_error),
-  FT_ENTRY ("error",         0,  1,  1,  func_error),
-  FT_ENTRY ("warning",       0,  1,  1,  func_error),
-  FT_ENTRY ("if",            2,  3,  0,  func_if),
-  FT_ENTRY ("or",            1,  0,  0,  func_or),
-  FT_ENTRY ("and",           1,  0,  0,  func_and),
-  FT_ENTRY ("value",         0,  1,  1,  func_value),
-  FT_ENTRY ("eval",          0,  1,  1,  func_eval),
-  FT_ENTRY ("file",          1,  2,  1,  func_file),
+ /*         Name            MIN MAX EXP? PURE Function */
+  FT_ENTRY ("abspath",       0,  1,  1,  0,  func_abspath),
+  FT_ENTRY ("addprefix",     2,  2,  1,  1,  func_addsuffix_addprefix),
+  FT_ENTRY ("addsuffix",     2,  2,  1,  1,  func_addsuffix_addprefix),
+  FT_ENTRY ("basename",      0,  1,  1,  1,  func_basename_dir),
+  FT_ENTRY ("dir",           0,  1,  1,  1,  func_basename_dir),
+  FT_ENTRY ("notdir",        0,  1,  1,  1,  func_notdir_suffix),
+  FT_ENTRY ("subst",         3,  3,  1,  1,  func_subst),
+  FT_ENTRY ("suffix",        0,  1,  1,  1,  func_notdir_suffix),
+  FT_ENTRY ("filter",        2,  2,  1,  1,  func_filter_filterout),
+  FT_ENTRY ("filter-out",    2,  2,  1,  1,  func_filter_filterout),
+  FT_ENTRY ("findstring",    2,  2,  1,  1,  func_findstring),
+  FT_ENTRY ("firstword",     0,  1,  1,  1,  func_firstword),
+  FT_ENTRY ("flavor",        0,  1,  1,  0,  func_flavor),
+  FT_ENTRY ("join",          2,  2,  1,  1,  func_join),
+  FT_ENTRY ("lastword",      0,  1,  1,  1,  func_lastword),
+  FT_ENTRY ("patsubst",      3,  3,  1,  1,  func_patsubst),
+  FT_ENTRY ("realpath",      0,  1,  1,  0,  func_realpath),
+  FT_ENTRY ("shell",         0,  1,  1,  0,  func_shell),
+  FT_ENTRY ("cached-shell",  2,  2,  1,  0,  func_cached_shell),
+  FT_ENTRY ("sort",          0,  1,  1,  1,  func_sort),
+  FT_ENTRY ("strip",         0,  1,  1,  1,  func_strip),
+  FT_ENTRY ("wildcard",      0,  1,  1,  0,  func_wildcard),
+  FT_ENTRY ("word",          2,  2,  1,  1,  func_word),
+  FT_ENTRY ("wordlist",      3,  3,  1,  1,  func_wordlist),
+  FT_ENTRY ("words",         0,  1,  1,  1,  func_words),
+  FT_ENTRY ("origin",        0,  1,  1,  0,  func_origin),
+  FT_ENTRY ("foreach",       3,  3,  0,  0,  func_foreach),
+  FT_ENTRY ("call",          1,  0,  1,  0,  func_call),
+  FT_ENTRY ("info",          0,  1,  1,  0,  func_error),
+  FT_ENTRY ("error",         0,  1,  1,  0,  func_error),
+  FT_ENTRY ("warning",       0,  1,  1,  0,  func_error),
+  FT_ENTRY ("if",            2,  3,  0,  1,  func_if),
+  FT_ENTRY ("or",            1,  0,  0,  1,  func_or),
+  FT_ENTRY ("and",           1,  0,  0,  1,  func_and),
+  FT_ENTRY ("value",         0,  1,  1,  0,  func_value),
+  FT_ENTRY ("eval",          0,  1,  1,  0,  func_eval),
+  FT_ENTRY ("file",          1,  2,  1,  0,  func_file),
 #ifdef EXPERIMENTAL
-  FT_ENTRY ("eq",            2,  2,  1,  func_eq),
-  FT_ENTRY ("not",           0,  1,  1,  func_not),
+  FT_ENTRY ("eq",            2,  2,  1,  1,  func_eq),
+  FT_ENTRY ("not",           0,  1,  1,  1,  func_not),
 #endif
 };
 
 #define FUNCTION_TABLE_ENTRIES (sizeof (function_table_init) / sizeof (struct function_table_entry))
 
 
+/* The number of functions defined by load or guile.  Expansions compiled
+   before a function was defined are compiled again.  */
+
+unsigned int functions_defined = 0;
+
 /* These must come after the definition of function_table.  */
 
-static char *
+char *
 expand_builtin_function (char *o, int argc, char **argv,
                          const struct function_table_entry *entry_p)
 {
   char *p;
 
+  if (!entry_p->pure)
+    expansion_not_pure ();
+
   if (argc < (int)entry_p->minimum_args)
     fatal (*expanding_var, strlen (entry_p->name),
            _("insufficient number of arguments (%d) to function '%s'"),
@@ -2193,6 +2381,64 @@ handle_function (char **op, const char **stringp)
 
   return 1;
 }
+
+/* Like handle_function, but do not run the function call at *STRINGP: split
+   it for a compiled expansion.  If *STRINGP starts a call, return its table
+   entry, set *EXPANDP nonzero if its arguments are expanded before it runs,
+   and set *ARGSP to a malloc'd array of the start and end of each of its
+   *NARGSP arguments, split just as handle_function splits them.  *STRINGP is
+   left at the closing paren.  If the call is not terminated, *NARGSP is 0.  */
+
+const struct function_table_entry *
+split_function (const char **stringp, int *expandp,
+                const char ***argsp, int *nargsp)
+{
+  const struct function_table_entry *entry_p;
+  char openparen = (*stringp)[0];
+  char closeparen = openparen == '(' ? ')' : '}';
+  const char *beg, *end, *p;
+  const char **args;
+  int count = 0;
+  int nargs;
+
+  entry_p = lookup_function (*stringp + 1);
+  if (!entry_p)
+    return 0;
+
+  *nargsp = 0;
+  beg = next_token (*stringp + 1 + entry_p->len);
+
+  for (nargs=1, end=beg; *end != '\0'; ++end)
+    if (*end == ',')
+      ++nargs;
+    else if (*end == openparen)
+      ++count;
+    else if (*end == closeparen && --count < 0)
+      break;
+
+  if (count >= 0)
+    return entry_p;
+
+  *stringp = end;
+  *expandp = entry_p->expand_args;
+  *argsp = args = xmalloc (sizeof (char *) * 2 * nargs);
+
+  for (p=beg, nargs=0; p <= end; ++nargs)
+    {
+      const char *next;
+
+      if (nargs + 1 == entry_p->maximum_args
+          || (! (next = find_next_argument (openparen, closeparen, p, end))))
+        next = end;
+
+      args[2 * nargs] = p;
+      args[2 * nargs + 1] = next;
+      p = next + 1;
+    }
+
+  *nargsp = nargs;
+  return entry_p;
+}
 
 
 /* User-defined functions.  Expand the first argument as either a builtin
@@ -2332,9 +2578,11 @@ define_new_function (const gmk_floc *flocp, const char *name,
   ent->maximum_args = max;
   ent->expand_args = ANY_SET(flags, GMK_FUNC_NOEXPAND) ? 0 : 1;
   ent->alloc_fn = 1;
+  ent->pure = 0;
   ent->fptr.alloc_func_ptr = func;
 
   hash_insert (&function_table, ent);
+  ++functions_defined;
 }
 
 void
@@ -25,15 +25,114 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 static void hash_rehash __P((struct hash_table* ht));
 static unsigned long round_up_2 __P((unsigned long rough));
 
-/* Implement double hashing with open addressing.  The table size is
-   always a power of two.  The secondary ('increment') hash function
-   is forced to return an odd-value, in order to be relatively prime
-   to the table size.  This guarantees that the increment can
-   potentially hit every slot in the table during collision
-   resolution.  */
+/* Implement open addressing with linear probing, in the manner of the
+   "Swiss tables" of Abseil.  The table size is always a power of two.
+   Alongside the vector of items is a vector of control bytes, one for
+   each slot: CTRL_EMPTY, CTRL_DELETED, or for a slot holding an item, 7
+   bits of the item's hash.  A lookup looks at the control bytes of
+   GROUP_WIDTH slots at once, with SSE2 where it is available, and calls
+   the comparison function only for the slots whose bits match the key's,
+   stopping at the first group with an empty slot.
+
+   The primary hash function gives both the slot to start at and the 7
+   bits, after mixing its value so that the weak string hashes callers
+   use spread well.  The secondary hash function is not used.
+
+   The first GROUP_WIDTH control bytes are repeated after the last, so a
+   group can always be read in one piece; tables therefore have at least
+   GROUP_WIDTH slots.  */
+
+#define GROUP_WIDTH     16
+#define CTRL_EMPTY      0x80
+#define CTRL_DELETED    0xfe
 
 void *hash_deleted_item = &hash_deleted_item;
 
+/* Mix the value of the primary hash function of KEY.  */
+
+static unsigned long
+hash_mix (struct hash_table *ht, const void *key)
+{
+  unsigned long h = (*ht->ht_hash_1) (key);
+
+  h ^= h >> 16;
+  h *= 0x45d9f3bUL;
+  h ^= h >> 16;
+  h *= 0x45d9f3bUL;
+  h ^= h >> 16;
+  return h;
+}
+
+#define CTRL_OF(h)      ((unsigned char) ((h) & 0x7f))
+#define SLOT_OF(h)      ((h) >> 7)
+
+/* Return a mask with bit N set for each byte N of the GROUP_WIDTH control
+   bytes at GROUP that is C.  */
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+
+static unsigned int
+group_match (const unsigned char *group, unsigned char c)
+{
+  __m128i g = _mm_loadu_si128 ((const __m128i *) group);
+  return _mm_movemask_epi8 (_mm_cmpeq_epi8 (g, _mm_set1_epi8 ((char) c)));
+}
+
+#else
+
+static unsigned int
+group_match (const unsigned char *group, unsigned char c)
+{
+  unsigned int mask = 0;
+  int i;
+
+  for (i = 0; i < GROUP_WIDTH; ++i)
+    if (group[i] == c)
+      mask |= 1U << i;
+  return mask;
+}
+
+#endif
+
+/* Return the number of the lowest bit set in MASK, which is not 0.  */
+
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+# define lowest_bit(_m) ((unsigned int) __builtin_ctz (_m))
+#else
+static unsigned int
+lowest_bit (unsigned int mask)
+{
+  unsigned int n = 0;
+  while (! (mask & 1))
+    {
+      mask >>= 1;
+      ++n;
+    }
+  return n;
+}
+#endif
+
+/* Set the control byte of slot N of HT, and its copy if it has one.  */
+
+static void
+set_ctrl (struct hash_table *ht, unsigned long n, unsigned char c)
+{
+  ht->ht_ctrl[n] = c;
+  if (n < GROUP_WIDTH)
+    ht->ht_ctrl[ht->ht_size + n] = c;
+}
+
+/* Allocate empty vectors of HT->ht_size slots for HT.  */
+
+static void
+hash_alloc (struct hash_table *ht)
+{
+  ht->ht_vec = (void**) CALLOC (struct token *, ht->ht_size);
+  ht->ht_ctrl = MALLOC (unsigned char, ht->ht_size + GROUP_WIDTH);
+  memset (ht->ht_ctrl, CTRL_EMPTY, ht->ht_size + GROUP_WIDTH);
+}
+
 /* Force the table size to be a power of two, possibly rounding up the
    given size.  */
 
@@ -41,20 +140,15 @@ void
 hash_init (struct hash_table *ht, unsigned long size,
            hash_func_t hash_1, hash_func_t hash_2, hash_cmp_func_t hash_cmp)
 {
-  ht->ht_size = round_up_2 (size);
+  ht->ht_size = round_up_2 (size < GROUP_WIDTH ? GROUP_WIDTH : size);
   ht->ht_empty_slots = ht->ht_size;
-  ht->ht_vec = (void**) CALLOC (struct token *, ht->ht_size);
-  if (ht->ht_vec == 0)
-    {
-      fprintf (stderr, _("can't allocate %lu bytes for hash table: memory exhausted"),
-	       ht->ht_size * (unsigned long) sizeof (struct token *));
-      exit (MAKE_TROUBLE);
-    }
+  hash_alloc (ht);
 
-  ht->ht_capacity = ht->ht_size - (ht->ht_size / 16); /* 93.75% loading factor */
+  ht->ht_capacity = ht->ht_size - (ht->ht_size / 8); /* 87.5% loading factor */
   ht->ht_fill = 0;
   ht->ht_collisions = 0;
   ht->ht_lookups = 0;
+  ht->ht_probes = 0;
   ht->ht_rehashes = 0;
   ht->ht_hash_1 = hash_1;
   ht->ht_hash_2 = hash_2;
@@ -75,46 +169,69 @@ hash_load (struct hash_table *ht, void *item_table,
     }
 }
 
-/* Returns the address of the table slot matching 'key'.  If 'key' is
-   not found, return the address of an empty slot suitable for
-   inserting 'key'.  The caller is responsible for incrementing
-   ht_fill on insertion.  */
+/* Find the slot for KEY as hash_find_slot does, and set *CTRLP to the
+   control byte for it.  */
 
-void **
-hash_find_slot (struct hash_table *ht, const void *key)
+static void **
+find_slot (struct hash_table *ht, const void *key, unsigned char *ctrlp)
 {
-  void **slot;
+  unsigned long size_mask = ht->ht_size - 1;
+  unsigned long h = hash_mix (ht, key);
+  unsigned char ctrl = CTRL_OF (h);
+  unsigned long pos = SLOT_OF (h) & size_mask;
   void **deleted_slot = 0;
-  unsigned int hash_2 = 0;
-  unsigned int hash_1 = (*ht->ht_hash_1) (key);
+  void **slot;
 
+  *ctrlp = ctrl;
   ht->ht_lookups++;
   for (;;)
     {
-      hash_1 &= (ht->ht_size - 1);
-      slot = &ht->ht_vec[hash_1];
+      const unsigned char *group = &ht->ht_ctrl[pos];
+      unsigned int match = group_match (group, ctrl);
+      unsigned int empty;
 
-      if (*slot == 0)
-	return (deleted_slot ? deleted_slot : slot);
-      if (*slot == hash_deleted_item)
-	{
-	  if (deleted_slot == 0)
-	    deleted_slot = slot;
-	}
-      else
+      while (match)
 	{
-	  if (key == *slot)
-	    return slot;
-	  if ((*ht->ht_compare) (key, *slot) == 0)
+	  unsigned int i = lowest_bit (match);
+	  slot = &ht->ht_vec[(pos + i) & size_mask];
+	  if (key == *slot || (*ht->ht_compare) (key, *slot) == 0)
 	    return slot;
 	  ht->ht_collisions++;
+	  match &= match - 1;
+	}
+
+      /* If the group has an empty slot, the key is not in the table.
+	 Return the first deleted slot before it, if any, else it.  */
+      empty = group_match (group, CTRL_EMPTY);
+      if (deleted_slot == 0)
+	{
+	  unsigned int deleted = group_match (group, CTRL_DELETED);
+	  if (empty)
+	    deleted &= (1U << lowest_bit (empty)) - 1;
+	  if (deleted)
+	    deleted_slot = &ht->ht_vec[(pos + lowest_bit (deleted)) & size_mask];
 	}
-      if (!hash_2)
-	  hash_2 = (*ht->ht_hash_2) (key) | 1;
-      hash_1 += hash_2;
+      if (empty)
+	return deleted_slot
+	  ? deleted_slot : &ht->ht_vec[(pos + lowest_bit (empty)) & size_mask];
+
+      pos = (pos + GROUP_WIDTH) & size_mask;
+      ht->ht_probes++;
     }
 }
 
+/* Returns the address of the table slot matching 'key'.  If 'key' is
+   not found, return the address of an empty slot suitable for
+   inserting 'key'.  The caller is responsible for incrementing
+   ht_fill on insertion.  */
+
+void **
+hash_find_slot (struct hash_table *ht, const void *key)
+{
+  unsigned char ctrl;
+  return find_slot (ht, key, &ctrl);
+}
+
 void *
 hash_find_item (struct hash_table *ht, const void *key)
 {
@@ -137,10 +254,12 @@ hash_insert_at (struct hash_table *ht, const void *item, const void *slot)
   const void *old_item = *(void **) slot;
   if (HASH_VACANT (old_item))
     {
+      unsigned char ctrl = CTRL_OF (hash_mix (ht, item));
       ht->ht_fill++;
       if (old_item == 0)
 	ht->ht_empty_slots--;
       old_item = item;
+      set_ctrl (ht, (void **) slot - ht->ht_vec, ctrl);
     }
   *(void const **) slot = item;
   if (ht->ht_empty_slots < ht->ht_size - ht->ht_capacity)
@@ -166,6 +285,7 @@ hash_delete_at (struct hash_table *ht, const void *slot)
   if (!HASH_VACANT (item))
     {
       *(void const **) slot = hash_deleted_item;
+      set_ctrl (ht, (void **) slot - ht->ht_vec, CTRL_DELETED);
       ht->ht_fill--;
       return item;
     }
@@ -185,6 +305,7 @@ hash_free_items (struct hash_table *ht)
 	free (item);
       *vec = 0;
     }
+  memset (ht->ht_ctrl, CTRL_EMPTY, ht->ht_size + GROUP_WIDTH);
   ht->ht_fill = 0;
   ht->ht_empty_slots = ht->ht_size;
 }
@@ -196,9 +317,11 @@ hash_delete_items (struct hash_table *ht)
   void **end = &vec[ht->ht_size];
   for (; vec < end; vec++)
     *vec = 0;
+  memset (ht->ht_ctrl, CTRL_EMPTY, ht->ht_size + GROUP_WIDTH);
   ht->ht_fill = 0;
   ht->ht_collisions = 0;
   ht->ht_lookups = 0;
+  ht->ht_probes = 0;
   ht->ht_rehashes = 0;
   ht->ht_empty_slots = ht->ht_size;
 }
@@ -214,7 +337,9 @@ hash_free (struct hash_table *ht, int free_items)
       ht->ht_empty_slots = ht->ht_size;
     }
   free (ht->ht_vec);
+  free (ht->ht_ctrl);
   ht->ht_vec = 0;
+  ht->ht_ctrl = 0;
   ht->ht_capacity = 0;
 }
 
@@ -251,26 +376,30 @@ hash_rehash (struct hash_table *ht)
 {
   unsigned long old_ht_size = ht->ht_size;
   void **old_vec = ht->ht_vec;
+  unsigned char *old_ctrl = ht->ht_ctrl;
   void **ovp;
 
   if (ht->ht_fill >= ht->ht_capacity)
     {
       ht->ht_size *= 2;
-      ht->ht_capacity = ht->ht_size - (ht->ht_size >> 4);
+      ht->ht_capacity = ht->ht_size - (ht->ht_size >> 3);
     }
   ht->ht_rehashes++;
-  ht->ht_vec = (void **) CALLOC (struct token *, ht->ht_size);
+  hash_alloc (ht);
 
   for (ovp = old_vec; ovp < &old_vec[old_ht_size]; ovp++)
     {
       if (! HASH_VACANT (*ovp))
 	{
-	  void **slot = hash_find_slot (ht, *ovp);
+	  unsigned char ctrl;
+	  void **slot = find_slot (ht, *ovp, &ctrl);
 	  *slot = *ovp;
+	  set_ctrl (ht, slot - ht->ht_vec, ctrl);
 	}
     }
   ht->ht_empty_slots = ht->ht_size - ht->ht_fill;
   free (old_vec);
+  free (old_ctrl);
 }
 
 void
@@ -41,6 +41,7 @@ typedef void (*hash_map_arg_func_t) __P((void const *item, void *arg));
 struct hash_table
 {
   void **ht_vec;
+  unsigned char *ht_ctrl;	/* per-slot hash fingerprints, see hash.c */
   hash_func_t ht_hash_1;	/* primary hash function */
   hash_func_t ht_hash_2;	/* secondary hash function */
   hash_cmp_func_t ht_compare;	/* comparison function */
@@ -50,6 +51,7 @@ struct hash_table
   unsigned long ht_empty_slots;	/* empty slots not including deleted slots */
   unsigned long ht_collisions;	/* # of failed calls to comparison function */
   unsigned long ht_lookups;	/* # of queries */
+  unsigned long ht_probes;	/* # of slots looked at past the first */
   unsigned int ht_rehashes;	/* # of times we've expanded table */
 };
 
@@ -79,13 +81,18 @@ extern void *hash_deleted_item;
 
 /* hash and comparison macros for case-sensitive string keys. */
 
+/* The primary hashes are FNV-1a, which unlike the secondary ones spread
+   names that differ only in a digit or two over the whole table.  */
+
+#define HASH_FNV_PRIME  16777619UL
+
 /* Due to the strcache, it's not uncommon for the string pointers to
    be identical.  Take advantage of that to short-circuit string compares.  */
 
 #define STRING_HASH_1(KEY, RESULT) do { \
-  unsigned char const *_key_ = (unsigned char const *) (KEY) - 1; \
-  while (*++_key_) \
-    (RESULT) += (*_key_ << (_key_[1] & 0xf)); \
+  unsigned char const *_key_ = (unsigned char const *) (KEY); \
+  while (*_key_) \
+    (RESULT) = ((RESULT) ^ *_key_++) * HASH_FNV_PRIME; \
 } while (0)
 #define return_STRING_HASH_1(KEY) do { \
   unsigned long _result_ = 0; \
@@ -113,12 +120,10 @@ extern void *hash_deleted_item;
 
 
 #define STRING_N_HASH_1(KEY, N, RESULT) do { \
-  unsigned char const *_key_ = (unsigned char const *) (KEY) - 1; \
+  unsigned char const *_key_ = (unsigned char const *) (KEY); \
   int _n_ = (N); \
-  if (_n_) \
-    while (--_n_ && *++_key_) \
-      (RESULT) += (*_key_ << (_key_[1] & 0xf)); \
-  (RESULT) += *++_key_; \
+  while (_n_-- > 0 && *_key_) \
+    (RESULT) = ((RESULT) ^ *_key_++) * HASH_FNV_PRIME; \
 } while (0)
 #define return_STRING_N_HASH_1(KEY, N) do { \
   unsigned long _result_ = 0; \
@@ -152,9 +157,10 @@ extern void *hash_deleted_item;
 /* hash and comparison macros for case-insensitive string _key_s. */
 
 #define ISTRING_HASH_1(KEY, RESULT) do { \
-  unsigned char const *_key_ = (unsigned char const *) (KEY) - 1; \
-  while (*++_key_) \
-    (RESULT) += ((isupper (*_key_) ? tolower (*_key_) : *_key_) << (_key_[1] & 0xf)); \
+  unsigned char const *_key_ = (unsigned char const *) (KEY); \
+  for (; *_key_; ++_key_) \
+    (RESULT) = ((RESULT) ^ (isupper (*_key_) ? tolower (*_key_) : *_key_)) \
+               * HASH_FNV_PRIME; \
 } while (0)
 #define return_ISTRING_HASH_1(KEY) do { \
   unsigned long _result_ = 0; \
@@ -257,6 +257,10 @@ pattern_search (struct file *file, int archive,
 
   PATH_VAR (stem_str); /* @@ Need to get rid of stem, stemlen, etc. */
 
+  trace_begin ("implicit", filename, 0);
+  STATS_START (STATS_IMPLICIT);
+  STATS_COUNT (STATS_SEARCHES);
+
 #ifndef NO_ARCHIVES
   if (archive || ar_name (filename))
     lastslash = 0;
@@ -721,7 +725,7 @@ pattern_search (struct file *file, int archive,
                      FILENAME's directory), so it might actually exist.  */
 
                   /* @@ dep->changed check is disabled. */
-                  if (lookup_file (d->name) != 0
+                  if (lookup_cached_file (d->name) != 0
                       /*|| ((!dep->changed || check_lastslash) && */
                       || file_exists_p (d->name))
                     {
@@ -848,7 +852,7 @@ pattern_search (struct file *file, int archive,
              and cmds of F below are null before we change them.  */
 
           struct file *imf = pat->file;
-          struct file *f = lookup_file (imf->name);
+          struct file *f = lookup_cached_file (imf->name);
 
           /* We don't want to delete an intermediate file that happened
              to be a prerequisite of some (other) target. Mark it as
@@ -889,7 +893,7 @@ pattern_search (struct file *file, int archive,
         dep->name = s;
       else
         {
-          dep->file = lookup_file (s);
+          dep->file = lookup_cached_file (s);
           if (dep->file == 0)
             dep->file = enter_file (s);
         }
@@ -984,5 +988,8 @@ pattern_search (struct file *file, int archive,
   free (tryrules);
   free (deplist);
 
+  STATS_STOP (STATS_IMPLICIT);
+  trace_end (0);
+
   return rule != 0;
 }
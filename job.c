@@ -61,6 +61,11 @@ int batch_mode_shell = 0;
 # include <sys/wait.h>
 #endif
 
+#if defined (HAVE_SPAWN_H) && defined (HAVE_POSIX_SPAWNP)
+# include <spawn.h>
+# define USE_POSIX_SPAWN 1
+#endif
+
 #ifdef HAVE_WAITPID
 # define WAIT_NOHANG(status)    waitpid (-1, (status), WNOHANG)
 #else   /* Don't have waitpid.  */
@@ -156,6 +161,7 @@ static void start_job_command (struct child *child);
 static int load_too_high (void);
 static int job_next_command (struct child *);
 static int start_waiting_job (struct child *);
+static void start_job (struct child *);
 
 /* Chain of all live (or recently deceased) children.  */
 
@@ -173,6 +179,12 @@ static int good_stdin_used = 0;
 
 static struct child *waiting_jobs = 0;
 
+/* Chain of children ready to run, in the order they are to be started in
+   under --schedule=critical-path.  */
+
+static struct child *ready_jobs = 0;
+static struct child *ready_jobs_tail = 0;
+
 /* Non-zero if we use a *real* shell (always so on Unix).  */
 
 int unixy_shell = 1;
@@ -790,6 +802,9 @@ reap_children (int block, int err)
 
       /* When we get here, all the commands for c->file are finished.  */
 
+      trace_end (c->trace_slot);
+      trace_slot_put (c->trace_slot);
+
 #ifndef NO_OUTPUT_SYNC
       /* Synchronize any remaining parallel output.  */
       output_dump (&c->output);
@@ -801,10 +816,16 @@ reap_children (int block, int err)
          it's interesting to check the file's modtime again now.  */
 
       if (! handling_fatal_signal)
-        /* Notice if the target of the commands has been changed.
-           This also propagates its values for command_state and
-           update_status to its also_make files.  */
-        notice_finished_file (c->file);
+        {
+          if (schedule == SCHEDULE_CRITICAL_PATH
+              && c->file->update_status == us_success)
+            schedule_record (c->file, schedule_clock () - c->start_time);
+
+          /* Notice if the target of the commands has been changed.
+             This also propagates its values for command_state and
+             update_status to its also_make files.  */
+          notice_finished_file (c->file);
+        }
 
       DB (DB_JOBS, (_("Removing child %p PID %s%s from chain.\n"),
                     c, pid2str (c->pid), c->remote ? _(" (remote)") : ""));
@@ -1272,8 +1293,33 @@ start_job_command (struct child *child)
         }
 #endif
 
-      child->pid = fork ();
+      STATS_START (STATS_SPAWN);
+
+      /* Start the child without forking if we can.  If we aren't running a
+         recursive command and we have a jobserver pipe, don't pass it on.  */
+      {
+        int close_fds[4];
+        int n = 0;
+
+        if (!(flags & COMMANDS_RECURSE) && job_fds[0] >= 0)
+          {
+            close_fds[n++] = job_fds[0];
+            close_fds[n++] = job_fds[1];
+          }
+        if (job_rfd >= 0)
+          close_fds[n++] = job_rfd;
+        close_fds[n] = -1;
+
+        child->pid = child_spawn_job (child->good_stdin ? FD_STDIN : bad_stdin,
+                                      outfd, errfd, argv, child->environment,
+                                      close_fds);
+      }
+
+      if (child->pid < 0)
+        child->pid = fork ();
       environ = parent_environ; /* Restore value child may have clobbered.  */
+      STATS_STOP (STATS_SPAWN);
+      STATS_COUNT (STATS_JOBS);
       if (child->pid == 0)
         {
           /* We are the child side.  */
@@ -1407,6 +1453,12 @@ start_waiting_job (struct child *c)
       return 0;
     }
 
+  if (schedule == SCHEDULE_CRITICAL_PATH)
+    c->start_time = schedule_clock ();
+
+  c->trace_slot = trace_slot_get ();
+  trace_begin ("job", f->name, c->trace_slot);
+
   /* Start the first command; reap_children will run later command lines.  */
   start_job_command (c);
 
@@ -1429,6 +1481,8 @@ start_waiting_job (struct child *c)
       /* FALLTHROUGH */
 
     case cs_finished:
+      trace_end (c->trace_slot);
+      trace_slot_put (c->trace_slot);
       notice_finished_file (f);
       free_child (c);
       break;
@@ -1451,6 +1505,10 @@ new_job (struct file *file)
   char **lines;
   unsigned int i;
 
+  /* From here on recipes may change any file: stop using prefetched
+     file times.  */
+  prefetch_finish ();
+
   /* Let any previously decided-upon jobs that are waiting
      for the load to go down start before this new one.  */
   start_waiting_jobs ();
@@ -1577,7 +1635,8 @@ new_job (struct file *file)
         memmove (out, in, strlen (in) + 1);
 
       /* Finally, expand the line.  */
-      lines[i] = allocated_variable_expand_for_file (cmds->command_lines[i],
+      lines[i] = allocated_compiled_expand_for_file (&cmds->compiled_lines[i],
+                                                     cmds->command_lines[i],
                                                      file);
     }
 
@@ -1586,6 +1645,54 @@ new_job (struct file *file)
   /* Fetch the first command line to be run.  */
   job_next_command (c);
 
+  /* With --schedule=critical-path the job is not started yet, but put on the
+     chain of ready jobs.  Once the goals have been walked and every job that
+     can run has been found, start_ready_jobs() starts as many as there are
+     free job slots for, longest time to the goals first.  */
+  if (schedule == SCHEDULE_CRITICAL_PATH && job_slots != 1 && !not_parallel
+      && !rebuilding_makefiles)
+    {
+      struct child **cp;
+
+      set_command_state (file, cs_running);
+      c->priority = schedule_priority (file);
+
+      if (ready_jobs_tail == 0 || ready_jobs_tail->priority >= c->priority)
+        cp = ready_jobs_tail ? &ready_jobs_tail->next : &ready_jobs;
+      else
+        for (cp = &ready_jobs; (*cp)->priority >= c->priority;
+             cp = &(*cp)->next)
+          ;
+      c->next = *cp;
+      *cp = c;
+      if (c->next == 0)
+        ready_jobs_tail = c;
+
+      DB (DB_JOBS, (_("Putting child %p (%s) on the ready chain (%lu).\n"),
+                    c, file->name, c->priority));
+
+      /* Tell update_goal_chain that commands will be run for the chain it is
+         processing, as start_job_command would have.  */
+      ++commands_started;
+
+      OUTPUT_UNSET ();
+      return;
+    }
+
+  start_job (c);
+}
+
+/* Wait for a job slot for the child C, whose first command line has been
+   fetched, and start it running.  */
+
+static void
+start_job (struct child *c)
+{
+  struct file *file = c->file;
+  struct commands *cmds = file->cmds;
+
+  OUTPUT_SET (&c->output);
+
   /* Wait for a job slot to be freed up.  If we allow an infinite number
      don't bother; also job_slots will == 0 if we're using the jobserver.  */
 
@@ -1909,7 +2016,49 @@ start_waiting_jobs (void)
 
   return;
 }
-
+
+/* Start jobs from the chain of ready jobs, highest priority first, as long
+   as there are job slots free for them, then return so update_goal_chain can
+   look for more: a job found ready later may go ahead of those still on the
+   chain.  With the jobserver there is no telling whether a token is free
+   short of waiting for one, so only one job that needs a token is started.
+   Return nonzero if jobs are left that need not wait for a child of ours.  */
+
+int
+start_ready_jobs (void)
+{
+  while (ready_jobs != 0)
+    {
+      struct child *c = ready_jobs;
+      int need_token = 0;
+
+      /* Don't wait for a job slot to be freed up: one of our children
+         finishing sends update_goal_chain round again anyway.  */
+      if (job_slots != 0 && job_slots_used >= job_slots)
+        return 0;
+
+#ifdef MAKE_JOBSERVER
+# ifdef WINDOWS32
+      need_token = job_slots == 0 && has_jobserver_semaphore ()
+                   && jobserver_tokens;
+# else
+      need_token = job_slots == 0 && job_fds[0] >= 0 && jobserver_tokens;
+# endif
+#endif
+
+      ready_jobs = c->next;
+      if (ready_jobs == 0)
+        ready_jobs_tail = 0;
+
+      start_job (c);
+
+      if (need_token)
+        return ready_jobs != 0;
+    }
+
+  return 0;
+}
+
 #ifndef WINDOWS32
 
 /* EMX: Start a child process. This function returns the new pid.  */
@@ -1942,6 +2091,107 @@ child_execute_job (int stdin_fd, int stdout_fd, int stderr_fd,
   /* Run the command.  */
   exec_command (argv, envp);
 }
+
+/* Start a process running the command in ARGV, set up as child_execute_job
+   would set it up, but without first making a copy of make to do it: with a
+   large database, copying make's address space costs more than the rest of
+   starting a job.  The descriptors in CLOSE_FDS, a list ended by -1, are
+   closed in the new process and the signals make blocks are unblocked.
+
+   Return the process ID, or -1 if the process could not be started this way.
+   Then the caller must fork and call child_execute_job instead, which also
+   reports why the command could not be run, or runs it with the shell.  */
+
+pid_t
+child_spawn_job (int stdin_fd, int stdout_fd, int stderr_fd,
+                 char **argv, char **envp, const int *close_fds)
+{
+#if defined (USE_POSIX_SPAWN) && !defined (GETLOADAVG_PRIVILEGED)
+  posix_spawn_file_actions_t fa;
+  posix_spawnattr_t attr;
+  sigset_t mask;
+  char **parent_environ;
+  pid_t pid;
+  int r;
+#ifdef SET_STACK_SIZE
+  struct rlimit rlim;
+#endif
+
+  if (posix_spawn_file_actions_init (&fa) != 0)
+    return -1;
+  if (posix_spawnattr_init (&attr) != 0)
+    {
+      posix_spawn_file_actions_destroy (&fa);
+      return -1;
+    }
+
+  /* The same redirections as child_execute_job.  */
+  r = 0;
+  if (stdin_fd != FD_STDIN)
+    {
+      r |= posix_spawn_file_actions_adddup2 (&fa, stdin_fd, FD_STDIN);
+      r |= posix_spawn_file_actions_addclose (&fa, stdin_fd);
+    }
+  if (stdout_fd != FD_STDOUT)
+    r |= posix_spawn_file_actions_adddup2 (&fa, stdout_fd, FD_STDOUT);
+  if (stderr_fd != FD_STDERR)
+    r |= posix_spawn_file_actions_adddup2 (&fa, stderr_fd, FD_STDERR);
+  if (stdout_fd != FD_STDOUT)
+    r |= posix_spawn_file_actions_addclose (&fa, stdout_fd);
+  if (stderr_fd != FD_STDERR && stderr_fd != stdout_fd)
+    r |= posix_spawn_file_actions_addclose (&fa, stderr_fd);
+
+  if (close_fds)
+    for (; *close_fds >= 0; ++close_fds)
+      r |= posix_spawn_file_actions_addclose (&fa, *close_fds);
+
+  sigemptyset (&mask);
+  r |= posix_spawnattr_setsigmask (&attr, &mask);
+  r |= posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETSIGMASK);
+
+  if (r != 0)
+    {
+      pid = -1;
+      goto done;
+    }
+
+#ifdef SET_STACK_SIZE
+  /* The new process gets make's limits: put back the stack limit make
+     started with while it is being created.  */
+  if (stack_limit.rlim_cur)
+    {
+      getrlimit (RLIMIT_STACK, &rlim);
+      setrlimit (RLIMIT_STACK, &stack_limit);
+    }
+#endif
+
+  /* Search for the program in the PATH of ENVP, as exec_command does.  */
+  parent_environ = environ;
+  environ = envp;
+  r = posix_spawnp (&pid, argv[0], &fa, &attr, argv, envp);
+  environ = parent_environ;
+
+#ifdef SET_STACK_SIZE
+  if (stack_limit.rlim_cur)
+    setrlimit (RLIMIT_STACK, &rlim);
+#endif
+
+  if (r != 0)
+    {
+      DB (DB_JOBS, (_("Cannot spawn '%s' (%s); forking instead.\n"),
+                    argv[0], strerror (r)));
+      pid = -1;
+    }
+
+ done:
+  posix_spawnattr_destroy (&attr);
+  posix_spawn_file_actions_destroy (&fa);
+  return pid;
+
+#else
+  return -1;
+#endif
+}
 #endif /* !WINDOWS32 */
 
 /* Replace the current process with one running the command in ARGV,
@@ -105,6 +105,9 @@ struct child
     unsigned int  command_line; /* Index into command_lines.  */
     struct output output;       /* Output for this child.  */
     pid_t         pid;          /* Child process's ID number.  */
+    unsigned long priority;     /* Order to start in, for --schedule.  */
+    unsigned long start_time;   /* When started, for --schedule.  */
+    unsigned int trace_slot;    /* Job slot, for --trace-events.  */
     unsigned int  remote:1;     /* Nonzero if executing remotely.  */
     unsigned int  noerror:1;    /* Nonzero if commands contained a '-'.  */
     unsigned int  good_stdin:1; /* Nonzero if this child has a good stdin.  */
@@ -118,6 +121,7 @@ int is_bourne_compatible_shell(const char *path);
 void new_job (struct file *file);
 void reap_children (int block, int err);
 void start_waiting_jobs (void);
+int start_ready_jobs (void);
 
 char **construct_command_argv (char *line, char **restp, struct file *file,
                                int cmd_flags, char** batch_file);
@@ -133,6 +137,8 @@ int child_execute_job (int stdin_fd, int stdout_fd, int stderr_fd,
 # else
 void child_execute_job (int stdin_fd, int stdout_fd, int stderr_fd,
                         char **argv, char **envp) __attribute__ ((noreturn));
+pid_t child_spawn_job (int stdin_fd, int stdout_fd, int stderr_fd,
+                       char **argv, char **envp, const int *close_fds);
 # endif
 #endif
 #ifdef _AMIGA
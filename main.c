@@ -149,6 +149,10 @@ int db_level = 0;
 
 char *output_sync_option = 0;
 
+/* Order in which to start jobs that are ready (--schedule).  */
+
+static char *schedule_option = 0;
+
 #ifdef WINDOWS32
 /* Suspend make in main for a short time to allow debugger to attach */
 
@@ -169,6 +173,15 @@ int ignore_errors_flag = 0;
 
 int print_data_base_flag = 0;
 
+/* Nonzero means print timers and counters when we exit (--stats).  */
+
+int stats_flag = 0;
+
+/* Nonzero means lay out each target's prerequisites together in memory
+   once the makefiles are read (--compact-deps).  */
+
+int compact_deps_flag = 0;
+
 /* Nonzero means don't remake anything; just return a nonzero status
    if the specified targets are not up to date (-q).  */
 
@@ -218,6 +231,24 @@ unsigned int job_slots = 1;
 unsigned int default_job_slots = 1;
 static unsigned int master_job_slots = 0;
 
+/* Number of threads used to prefetch file status (--stat-threads); zero
+   means don't prefetch.  */
+
+unsigned int stat_threads = 0;
+static unsigned int default_stat_threads = 0;
+
+/* Number of threads used to scan included makefiles (--parse-threads);
+   zero means scan them one at a time as they are read.  */
+
+unsigned int parse_threads = 0;
+static unsigned int default_parse_threads = 0;
+
+/* Number of shells kept running for $(shell) (--shell-pool); zero means
+   start a new shell for each.  */
+
+static unsigned int default_shell_pool = 0;
+static unsigned int noarg_shell_pool = 4;
+
 /* Value of job_slots that means no limit.  */
 
 static unsigned int inf_jobs = 0;
@@ -265,6 +296,22 @@ static struct stringlist *new_files = 0;
 /* List of strings to be eval'd.  */
 static struct stringlist *eval_strings = 0;
 
+/* File to cache the rules of included dependency makefiles in.  */
+
+char *depcache_file = 0;
+
+/* File to keep the recipe times used by --schedule=critical-path in.  */
+
+char *schedule_history = 0;
+
+/* File to cache the output of $(cached-shell ...) in.  */
+
+char *shellcache_file = 0;
+
+/* File to write trace events of the build to (--trace-events).  */
+
+char *trace_events_file = 0;
+
 /* If nonzero, we should just print usage and exit.  */
 
 static int print_usage_flag = 0;
@@ -308,10 +355,14 @@ static const char *const usage[] =
   -C DIRECTORY, --directory=DIRECTORY\n\
                               Change to DIRECTORY before doing anything.\n"),
     N_("\
+  --compact-deps              Keep prerequisite lists together in memory.\n"),
+    N_("\
   -d                          Print lots of debugging information.\n"),
     N_("\
   --debug[=FLAGS]             Print various types of debugging information.\n"),
     N_("\
+  --dep-cache=FILE            Cache rules of included dependency files in FILE.\n"),
+    N_("\
   -e, --environment-overrides\n\
                               Environment variables override makefiles.\n"),
     N_("\
@@ -345,6 +396,8 @@ static const char *const usage[] =
   -O[TYPE], --output-sync[=TYPE]\n\
                               Synchronize output of parallel jobs by TYPE.\n"),
     N_("\
+  --parse-threads=N           Scan included makefiles with N threads.\n"),
+    N_("\
   -p, --print-data-base       Print make's internal database.\n"),
     N_("\
   -q, --question              Run no recipe; exit status says if up to date.\n"),
@@ -355,13 +408,28 @@ static const char *const usage[] =
     N_("\
   -s, --silent, --quiet       Don't echo recipes.\n"),
     N_("\
+  --schedule=TYPE             Start ready jobs in order TYPE.\n"),
+    N_("\
+  --schedule-history=FILE     Keep recipe times for --schedule in FILE.\n"),
+    N_("\
+  --shell-cache=FILE          Cache the output of $(cached-shell) in FILE.\n"),
+    N_("\
+  --shell-pool[=N]            Keep N shells running for $(shell).  The\n\
+                              shell's error messages may differ.\n"),
+    N_("\
   -S, --no-keep-going, --stop\n\
                               Turns off -k.\n"),
     N_("\
+  --stat-threads=N            Check file times with N threads before building.\n"),
+    N_("\
+  --stats                     Print timers and counters when done.\n"),
+    N_("\
   -t, --touch                 Touch targets instead of remaking them.\n"),
     N_("\
   --trace                     Print tracing information.\n"),
     N_("\
+  --trace-events=FILE         Write a timeline of the build to FILE.\n"),
+    N_("\
   -v, --version               Print the version number of make and exit.\n"),
     N_("\
   -w, --print-directory       Print the current directory.\n"),
@@ -435,6 +503,21 @@ static const struct command_switch switches[] =
       "warn-undefined-variables" },
     { CHAR_MAX+6, strlist, &eval_strings, 1, 0, 0, 0, 0, "eval" },
     { CHAR_MAX+7, string, &sync_mutex, 1, 1, 0, 0, 0, "sync-mutex" },
+    { CHAR_MAX+8, string, &depcache_file, 1, 0, 0, 0, 0, "dep-cache" },
+    { CHAR_MAX+9, positive_int, &stat_threads, 1, 1, 0, 0,
+      &default_stat_threads, "stat-threads" },
+    { CHAR_MAX+10, string, &schedule_option, 1, 1, 0, 0, 0, "schedule" },
+    { CHAR_MAX+11, string, &schedule_history, 1, 1, 0, 0, 0,
+      "schedule-history" },
+    { CHAR_MAX+12, string, &trace_events_file, 1, 0, 0, 0, 0,
+      "trace-events" },
+    { CHAR_MAX+13, flag, &stats_flag, 1, 0, 0, 0, 0, "stats" },
+    { CHAR_MAX+14, positive_int, &shell_pool_size, 1, 1, 0,
+      &noarg_shell_pool, &default_shell_pool, "shell-pool" },
+    { CHAR_MAX+15, string, &shellcache_file, 1, 1, 0, 0, 0, "shell-cache" },
+    { CHAR_MAX+16, flag, &compact_deps_flag, 1, 1, 0, 0, 0, "compact-deps" },
+    { CHAR_MAX+17, positive_int, &parse_threads, 1, 1, 0, 0,
+      &default_parse_threads, "parse-threads" },
     { 0, 0, 0, 0, 0, 0, 0, 0, 0 }
   };
 
@@ -525,6 +608,10 @@ int one_shell;
 
 int output_sync = OUTPUT_SYNC_NONE;
 
+/* One of SCHEDULE_* as chosen by the "--schedule" option.  */
+
+int schedule = SCHEDULE_DEFAULT;
+
 /* Nonzero if the "--trace" option was given.  */
 
 int trace_flag = 0;
@@ -765,6 +852,21 @@ decode_output_sync_flags (void)
     RECORD_SYNC_MUTEX (sync_mutex);
 }
 
+static void
+decode_schedule_flags (void)
+{
+  if (schedule_option)
+    {
+      if (streq (schedule_option, "default"))
+        schedule = SCHEDULE_DEFAULT;
+      else if (streq (schedule_option, "critical-path"))
+        schedule = SCHEDULE_CRITICAL_PATH;
+      else
+        OS (fatal, NILF,
+            _("unknown schedule type '%s'"), schedule_option);
+    }
+}
+
 #ifdef WINDOWS32
 
 #ifndef NO_OUTPUT_SYNC
@@ -1021,6 +1123,8 @@ main (int argc, char **argv, char **envp)
 
   output_init (&make_sync);
 
+  stats_init ();
+
   initialize_stopchar_map();
 
 #ifdef SET_STACK_SIZE
@@ -1764,10 +1868,19 @@ main (int argc, char **argv, char **envp)
       define_variable_cname ("-*-eval-flags-*-", value, o_automatic, 0);
     }
 
+  if (trace_events_file)
+    trace_events_open (trace_events_file, restarts != 0);
+
   /* Read all the makefiles.  */
 
+  if (depcache_file)
+    depcache_load (depcache_file);
+
   read_files = read_all_makefiles (makefiles == 0 ? 0 : makefiles->list);
 
+  if (depcache_file)
+    depcache_save (depcache_file);
+
 #ifdef WINDOWS32
   /* look one last time after reading all Makefiles */
   if (no_default_sh_exe)
@@ -2026,9 +2139,11 @@ main (int argc, char **argv, char **envp)
       /* Set up 'MAKEFLAGS' specially while remaking makefiles.  */
       define_makeflags (1, 1);
 
+      trace_begin ("phase", "remake makefiles", 0);
       rebuilding_makefiles = 1;
       status = update_goal_chain (read_files);
       rebuilding_makefiles = 0;
+      trace_end (0);
 
       switch (status)
         {
@@ -2217,6 +2332,12 @@ main (int argc, char **argv, char **envp)
           fflush (stdout);
           fflush (stderr);
 
+          shell_pool_close ();
+          shellcache_save ();
+
+          /* The new make carries on with the trace.  */
+          trace_events_close (0);
+
           /* Close the dup'd jobserver pipe if we opened one.  */
           if (job_rfd >= 0)
             close (job_rfd);
@@ -2318,6 +2439,18 @@ main (int argc, char **argv, char **envp)
   DB (DB_BASIC, (_("Updating goal targets....\n")));
 
   {
+    if (stat_threads)
+      prefetch_mtimes (goals);
+
+    if (schedule == SCHEDULE_CRITICAL_PATH)
+      {
+        if (! schedule_history)
+          schedule_history = xstrdup (".make-schedule");
+        schedule_load (schedule_history);
+      }
+
+    trace_begin ("phase", "update goals", 0);
+
     switch (update_goal_chain (goals))
     {
       case us_none:
@@ -2336,6 +2469,13 @@ main (int argc, char **argv, char **envp)
         break;
     }
 
+    trace_end (0);
+
+    prefetch_finish ();
+
+    if (schedule == SCHEDULE_CRITICAL_PATH)
+      schedule_save (schedule_history, goals);
+
     /* If we detected some clock skew, generate one last warning */
     if (clock_skew_detected)
       O (error, NILF,
@@ -2668,9 +2808,17 @@ decode_switches (int argc, const char **argv, int env)
 
                       if (i < 1 || cp[0] != '\0')
                         {
-                          error (NILF, 0,
-                                 _("the '-%c' option requires a positive integer argument"),
-                                 cs->c);
+                          char opt[2] = "c";
+                          const char *op = opt;
+
+                          if (short_option (cs->c))
+                            opt[0] = cs->c;
+                          else
+                            op = cs->long_name;
+
+                          error (NILF, strlen (op),
+                                 _("the '%s%s' option requires a positive integer argument"),
+                                 short_option (cs->c) ? "-" : "--", op);
                           bad = 1;
                         }
                       else
@@ -2717,6 +2865,7 @@ decode_switches (int argc, const char **argv, int env)
   /* If there are any options that need to be decoded do it now.  */
   decode_debug_flags ();
   decode_output_sync_flags ();
+  decode_schedule_flags ();
 }
 
 /* Decode switches from environment variable ENVAR (which is LEN chars long).
@@ -3211,6 +3360,14 @@ die (int status)
       while (job_slots_used > 0)
         reap_children (1, err);
 
+      shell_pool_close ();
+      shellcache_save ();
+
+      trace_events_close (1);
+
+      if (stats_flag)
+        stats_print ();
+
       /* Let the remote job module clean up its state.  */
       remote_cleanup ();
 
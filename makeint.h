@@ -44,6 +44,14 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include <errno.h>
 #include <stdint.h>
 
+/* The nanoseconds of the modification time in struct stat ST, or zero if
+   configure found no field for them.  */
+#ifdef ST_MTIM_NSEC
+# define STAT_MTIME_NS(st) ((st).ST_MTIM_NSEC)
+#else
+# define STAT_MTIME_NS(st) 0
+#endif
+
 #ifndef isblank
 # define isblank(c)     ((c) == ' ' || (c) == '\t')
 #endif
@@ -192,6 +200,25 @@ void *xcalloc (unsigned int);
 void *xrealloc (void *, unsigned int);
 char *xstrdup (const char *);
 char *xstrndup (const char *, unsigned int);
+
+/* Arenas of objects of one size that are allocated many at a time.  */
+struct arena
+  {
+    const char *name;           /* What the objects are, for --stats.  */
+    unsigned int size;          /* Size of each object.  */
+    char *next;                 /* Next unused object in the current block.  */
+    char *end;                  /* End of the current block.  */
+    void *free_list;            /* Objects freed, to be used again.  */
+    unsigned long live;         /* Objects in use.  */
+    unsigned long peak;         /* Most objects in use at once.  */
+    unsigned long blocks;       /* Number of blocks allocated.  */
+    unsigned long bytes;        /* Total size of the blocks.  */
+  };
+#define ARENA_INIT(_name, _type) \
+  { (_name), sizeof (_type), 0, 0, 0, 0, 0, 0, 0 }
+void *arena_alloc (struct arena *);
+void *arena_alloc_array (struct arena *, unsigned int);
+void arena_free (struct arena *, void *);
 char *find_next_token (const char **, unsigned int *);
 char *next_token (const char *);
 char *end_of_token (const char *);
@@ -201,6 +228,8 @@ int alpha_compare (const void *, const void *);
 void print_spaces (unsigned int);
 char *find_percent (char *);
 const char *find_percent_cached (const char **);
+char *read_cache_file (const char *, size_t *);
+int replace_cache_file (const char *, void (*) (FILE *));
 
 #ifndef NO_ARCHIVES
 int ar_name (const char *);
@@ -226,6 +255,7 @@ int file_impossible_p (const char *);
 void file_impossible (const char *);
 const char *dir_name (const char *);
 void hash_init_directories (void);
+void print_dir_stats (void);
 
 void define_default_variables (void);
 void undefine_default_variables (void);
@@ -237,6 +267,7 @@ void build_vpath_lists (void);
 void construct_vpath_list (char *pattern, char *dirpath);
 const char *vpath_search (const char *file, FILE_TIMESTAMP *mtime_ptr,
                           unsigned int* vpath_index, unsigned int* path_index);
+void vpath_prefetch (const char *file);
 int gpath_search (const char *file, unsigned int len);
 
 void construct_include_path (const char **arg_dirs);
@@ -250,9 +281,88 @@ char *strip_whitespace (const char **begpp, const char **endpp);
 /* String caching  */
 void strcache_init (void);
 void strcache_print_stats (const char *prefix);
+void strcache_print_memory_stats (void);
+void strcache_print_hash_stats (void);
 int strcache_iscached (const char *str);
 const char *strcache_add (const char *str);
 const char *strcache_add_len (const char *str, unsigned int len);
+unsigned long strcache_hash (const char *str);
+unsigned int strcache_len (const char *str);
+
+/* Dependency makefile caching  */
+void depcache_load (const char *file);
+const char *depcache_lookup (const char *name, unsigned int *lenp);
+void depcache_store (const char *name, const struct stat *st,
+                     const char *rules, unsigned int len);
+void depcache_save (const char *file);
+
+/* Shell function result caching  */
+char *shellcache_key (const char *files, char **argv, unsigned int *lenp);
+const char *shellcache_lookup (const char *command, const char *key,
+                               unsigned int key_len, unsigned int *lenp);
+void shellcache_store (const char *command, const char *key,
+                       unsigned int key_len, const char *output,
+                       unsigned int len);
+void shellcache_save (void);
+
+/* Trace events (--trace-events)  */
+void trace_events_open (const char *file, int append);
+void trace_events_close (int last);
+void trace_begin (const char *cat, const char *name, unsigned int tid);
+void trace_end (unsigned int tid);
+unsigned int trace_slot_get (void);
+void trace_slot_put (unsigned int tid);
+
+/* Shell coprocesses for $(shell) (--shell-pool)  */
+int shell_pool_run (char **argv, int *statusp, int *sigp, char **bufferp,
+                    unsigned int *lenp);
+void shell_pool_close (void);
+void shell_pool_remove (void);
+
+/* Timers and counters (--stats)  */
+enum stats_timer
+  {
+    STATS_PARSE,                /* Reading makefiles.  */
+    STATS_EXPAND,               /* Expanding variables and functions.  */
+    STATS_IMPLICIT,             /* Searching for implicit rules.  */
+    STATS_STAT,                 /* Getting file status.  */
+    STATS_READDIR,              /* Reading directories.  */
+    STATS_SPAWN,                /* Starting jobs and $(shell) commands.  */
+    STATS_SYNC,                 /* Waiting to write synchronized output.  */
+    STATS_TIMERS
+  };
+
+enum stats_count
+  {
+    STATS_MAKEFILES,
+    STATS_MAPPED,
+    STATS_DEPFILES,
+    STATS_EXPANSIONS,
+    STATS_COMPILED,
+    STATS_MEMOIZED,
+    STATS_SHELLS,
+    STATS_SEARCHES,
+    STATS_STATS,
+    STATS_DIRS,
+    STATS_DIRENTS,
+    STATS_JOBS,
+    STATS_COMPACTED,
+    STATS_COUNTS
+  };
+
+extern unsigned long stats_counts[];
+
+#define STATS_COUNT(_c)     (++stats_counts[_c])
+#define STATS_START(_t)     do{ if (stats_flag) stats_start (_t); }while(0)
+#define STATS_STOP(_t)      do{ if (stats_flag) stats_stop (_t); }while(0)
+
+struct hash_table;
+void stats_init (void);
+void stats_start (enum stats_timer timer);
+void stats_stop (enum stats_timer timer);
+void stats_print_hash (const char *name, struct hash_table *ht);
+void stats_print_arena (const struct arena *a);
+void stats_print (void);
 
 /* Guile support  */
 int guile_gmake_setup (const gmk_floc *flocp);
@@ -267,6 +377,9 @@ void unload_file (const char *name);
 #define OUTPUT_SYNC_TARGET  2
 #define OUTPUT_SYNC_RECURSE 3
 
+#define SCHEDULE_DEFAULT       0
+#define SCHEDULE_CRITICAL_PATH 1
+
 extern const gmk_floc *reading_file;
 extern const gmk_floc **expanding_var;
 
@@ -281,6 +394,7 @@ extern int print_version_flag, print_directory_flag, check_symlink_flag;
 extern int warn_undefined_variables_flag, trace_flag, posix_pedantic;
 extern int not_parallel, second_expansion, clock_skew_detected;
 extern int rebuilding_makefiles, one_shell, output_sync, verify_flag;
+extern int schedule, stats_flag, compact_deps_flag;
 
 /* can we run commands via 'sh -c xxx' or must we use batch files? */
 extern int batch_mode_shell;
@@ -291,6 +405,9 @@ extern int batch_mode_shell;
 extern char cmd_prefix;
 
 extern unsigned int job_slots;
+extern unsigned int stat_threads;
+extern unsigned int parse_threads;
+extern unsigned int shell_pool_size;
 extern int job_fds[2];
 extern int job_rfd;
 #ifndef NO_FLOAT
@@ -306,6 +423,11 @@ extern char *version_string, *remote_description, *make_host;
 
 extern unsigned int commands_started;
 
+extern char *depcache_file;
+extern char *schedule_history;
+extern char *shellcache_file;
+extern char *trace_events_file;
+
 extern int handling_fatal_signal;
 
 
@@ -251,6 +251,124 @@ xstrdup (const char *ptr)
 
 #endif  /* HAVE_DMALLOC_H */
 
+/* Size of the blocks arenas allocate objects from.  */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/* Objects are aligned for any of these.  */
+union arena_align
+  {
+    void *p;
+    long l;
+    double d;
+    FILE_TIMESTAMP t;
+  };
+
+#define ARENA_ALIGN(_s) \
+  (((_s) + sizeof (union arena_align) - 1) & ~(sizeof (union arena_align) - 1))
+
+/* Return a new zeroed object from arena A.  Objects freed with arena_free()
+   are used again first; otherwise they are carved from large blocks, which
+   saves malloc's overhead on each object and keeps objects allocated
+   together close together in memory.  */
+
+void *
+arena_alloc (struct arena *a)
+{
+  unsigned int size = ARENA_ALIGN (a->size);
+  void *p;
+
+#ifdef HAVE_DMALLOC_H
+  /* Let dmalloc see each object.  */
+  p = xcalloc (size);
+#else
+  if (a->free_list)
+    {
+      p = a->free_list;
+      a->free_list = *(void **) p;
+    }
+  else
+    {
+      if (a->next == 0 || a->end - a->next < (long) size)
+        {
+          unsigned int bsize = size * 16 > ARENA_BLOCK_SIZE
+                               ? size * 16 : ARENA_BLOCK_SIZE;
+          a->next = xmalloc (bsize);
+          a->end = a->next + bsize;
+          ++a->blocks;
+          a->bytes += bsize;
+        }
+      p = a->next;
+      a->next += size;
+    }
+  memset (p, '\0', size);
+#endif
+
+  if (++a->live > a->peak)
+    a->peak = a->live;
+  return p;
+}
+
+/* Return N new zeroed objects from arena A, one after another in memory as
+   in a C array of them, or null if A cannot provide them.  Each may be given
+   back with arena_free().  */
+
+void *
+arena_alloc_array (struct arena *a, unsigned int n)
+{
+#ifdef HAVE_DMALLOC_H
+  /* Each object must be a separate allocation.  */
+  return 0;
+#else
+  unsigned int size = ARENA_ALIGN (a->size);
+  unsigned long need = (unsigned long) size * n;
+  void *p;
+
+  /* If the objects are padded in the arena (as 'struct dep' is on ILP32
+     hosts), indexing the array would not find them where arena_free() and
+     arena_alloc() expect.  */
+  if (size != a->size)
+    return 0;
+
+  if (a->next == 0 || a->end - a->next < (long) need)
+    {
+      /* Start a new block, big enough for all of them.  The rest of the
+         current one is left unused.  */
+      unsigned long bsize = need > ARENA_BLOCK_SIZE ? need : ARENA_BLOCK_SIZE;
+      a->next = xmalloc (bsize);
+      a->end = a->next + bsize;
+      ++a->blocks;
+      a->bytes += bsize;
+    }
+  p = a->next;
+  a->next += need;
+  memset (p, '\0', need);
+
+  a->live += n;
+  if (a->live > a->peak)
+    a->peak = a->live;
+  return p;
+#endif
+}
+
+/* Give object P back to arena A.  */
+
+void
+arena_free (struct arena *a, void *p)
+{
+  --a->live;
+#ifdef HAVE_DMALLOC_H
+  free (p);
+#else
+  *(void **) p = a->free_list;
+  a->free_list = p;
+#endif
+}
+
+/* The arena of 'struct dep' and 'struct nameseq'.  Names are allocated at the
+   size of a dep, so that either can be freed as the other.  */
+
+struct arena dep_arena = ARENA_INIT ("deps and names", struct dep);
+
 char *
 xstrndup (const char *str, unsigned int length)
 {
@@ -287,6 +405,99 @@ lindex (const char *s, const char *limit, int c)
   return 0;
 }
 
+/* Words are separated by blanks: the MAP_BLANK characters, which are the
+   spaces and tabs of the C locale stopchar_map is set up in.
+
+   With SSE2, strings are scanned sixteen bytes at a time.  The loads are
+   aligned, so they never cross into a page past the end of the string, but
+   they do read bytes after its null; AddressSanitizer would report those, so
+   it gets the byte-at-a-time versions.  */
+
+#if defined(__SSE2__) && !defined(__SANITIZE_ADDRESS__)
+# define SCAN_WORDS_BY_GROUP
+#endif
+#if defined(__has_feature)
+# if __has_feature(address_sanitizer)
+#  undef SCAN_WORDS_BY_GROUP
+# endif
+#endif
+
+#ifdef SCAN_WORDS_BY_GROUP
+# include <emmintrin.h>
+
+# define GROUP_ALIGN(_s) ((const char *) ((uintptr_t) (_s) & ~(uintptr_t) 15))
+
+/* Return a mask with bit N set for each byte N of the aligned sixteen bytes
+   at P that is a blank.  Set *NULP to the mask of the bytes that are null.  */
+
+static unsigned int
+group_blanks (const char *p, unsigned int *nulp)
+{
+  __m128i g = _mm_load_si128 ((const __m128i *) p);
+
+  *nulp = _mm_movemask_epi8 (_mm_cmpeq_epi8 (g, _mm_setzero_si128 ()));
+  return _mm_movemask_epi8 (_mm_or_si128 (
+                              _mm_cmpeq_epi8 (g, _mm_set1_epi8 (' ')),
+                              _mm_cmpeq_epi8 (g, _mm_set1_epi8 ('\t'))));
+}
+
+/* Return the address of the first whitespace or null in the string S.  */
+
+char *
+end_of_token (const char *s)
+{
+  const char *p = GROUP_ALIGN (s);
+  unsigned int nul;
+  unsigned int stop = group_blanks (p, &nul) | nul;
+
+  /* Ignore the bytes of the first group before S.  */
+  stop >>= s - p;
+  if (stop)
+    return (char *)s + __builtin_ctz (stop);
+
+  do
+    {
+      p += 16;
+      stop = group_blanks (p, &nul) | nul;
+    }
+  while (! stop);
+
+  return (char *)p + __builtin_ctz (stop);
+}
+
+/* Return the address of the first nonwhitespace or null in the string S.  */
+
+char *
+next_token (const char *s)
+{
+  const char *p;
+  unsigned int nul;
+  unsigned int word;
+
+  /* Most words are separated by a single space.  */
+  if (! STOP_SET (*s, MAP_BLANK))
+    return (char *)s;
+  if (! STOP_SET (*++s, MAP_BLANK))
+    return (char *)s;
+
+  p = GROUP_ALIGN (s);
+  word = ~group_blanks (p, &nul) & 0xffff;
+  word >>= s - p;
+  if (word)
+    return (char *)s + __builtin_ctz (word);
+
+  do
+    {
+      p += 16;
+      word = ~group_blanks (p, &nul) & 0xffff;
+    }
+  while (! word);
+
+  return (char *)p + __builtin_ctz (word);
+}
+
+#else /* !SCAN_WORDS_BY_GROUP */
+
 /* Return the address of the first whitespace or null in the string S.  */
 
 char *
@@ -302,11 +513,13 @@ end_of_token (const char *s)
 char *
 next_token (const char *s)
 {
-  while (isblank ((unsigned char)*s))
+  while (STOP_SET (*s, MAP_BLANK))
     ++s;
   return (char *)s;
 }
 
+#endif /* !SCAN_WORDS_BY_GROUP */
+
 /* Find the next token in PTR; return the address of it, and store the length
    of the token into *LENGTHPTR if LENGTHPTR is not nil.  Set *PTR to the end
    of the token, so this function can be called repeatedly in a loop.  */
@@ -337,7 +550,7 @@ copy_dep_chain (const struct dep *d)
 
   while (d != 0)
     {
-      struct dep *c = xmalloc (sizeof (struct dep));
+      struct dep *c = alloc_dep ();
       memcpy (c, d, sizeof (struct dep));
 
       if (c->need_2nd_expansion)
@@ -378,7 +591,7 @@ free_ns_chain (struct nameseq *ns)
     {
       struct nameseq *t = ns;
       ns = ns->next;
-      free (t);
+      free_ns (t);
     }
 }
 
@@ -656,6 +869,84 @@ child_access (void)
 #endif  /* GETLOADAVG_PRIVILEGED */
 }
 
+/* Read all of FILE, one of the caches kept across runs, into a new buffer
+   with a null after the contents, and set *LENP to their length.  Return
+   null if FILE can't be read or is not a regular file: a cache that can't be
+   read is not an error, the caller simply starts with an empty one.  */
+
+char *
+read_cache_file (const char *file, size_t *lenp)
+{
+  FILE *fp;
+  struct stat st;
+  char *contents;
+  int e;
+
+  ENULLLOOP (fp, fopen (file, "r"));
+  if (fp == 0)
+    return 0;
+
+  /* The buffer, with its null, must fit in the unsigned int xmalloc takes.  */
+  EINTRLOOP (e, fstat (fileno (fp), &st));
+  if (e != 0 || ! S_ISREG (st.st_mode)
+      || (off_t) (unsigned int) (st.st_size + 1) != st.st_size + 1)
+    {
+      fclose (fp);
+      return 0;
+    }
+
+  contents = xmalloc (st.st_size + 1);
+  *lenp = fread (contents, 1, st.st_size, fp);
+  fclose (fp);
+  contents[*lenp] = '\0';
+
+  return contents;
+}
+
+/* Replace FILE, one of the caches kept across runs, with what WRITER writes
+   to the FILE * it is given.  It is written to a temporary file which is
+   then renamed, so that concurrent makes never see a partial cache.  Return
+   nonzero if FILE was replaced; otherwise an error has been printed.  */
+
+int
+replace_cache_file (const char *file, void (*writer) (FILE *))
+{
+  char *tmp;
+  FILE *fp;
+  int e;
+  int ok = 0;
+
+  tmp = xmalloc (strlen (file) + 1 + INTSTR_LENGTH + 1);
+  sprintf (tmp, "%s.%lu", file, (unsigned long) getpid ());
+
+  ENULLLOOP (fp, fopen (tmp, "w"));
+  if (fp == 0)
+    {
+      perror_with_name ("", tmp);
+      free (tmp);
+      return 0;
+    }
+
+  (*writer) (fp);
+
+  e = ferror (fp);
+  if (fclose (fp) != 0 || e)
+    {
+      perror_with_name ("", tmp);
+      unlink (tmp);
+    }
+  else if (rename (tmp, file) != 0)
+    {
+      perror_with_name ("", file);
+      unlink (tmp);
+    }
+  else
+    ok = 1;
+
+  free (tmp);
+  return ok;
+}
+
 #ifdef NEED_GET_PATH_MAX
 unsigned int
 get_path_max (void)
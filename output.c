@@ -218,12 +218,16 @@ static void *
 acquire_semaphore (void)
 {
   static struct flock fl;
+  int r;
 
   fl.l_type = F_WRLCK;
   fl.l_whence = SEEK_SET;
   fl.l_start = 0;
   fl.l_len = 1;
-  if (fcntl (sync_handle, F_SETLKW, &fl) != -1)
+  STATS_START (STATS_SYNC);
+  r = fcntl (sync_handle, F_SETLKW, &fl);
+  STATS_STOP (STATS_SYNC);
+  if (r != -1)
     return &fl;
   perror ("fcntl()");
   return NULL;
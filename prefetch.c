@@ -0,0 +1,606 @@
+/* Parallel prefetching of file status for GNU Make.
+Copyright (C) 2015 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+#include "filedef.h"
+#include "dep.h"
+#include "debug.h"
+#include "hash.h"
+
+#ifdef HAVE_PTHREADS
+# include <pthread.h>
+#endif
+
+#if defined (HAVE_LINUX_IO_URING_H) && defined (HAVE_SYS_SYSCALL_H) \
+    && HAVE_DECL_IORING_OP_STATX
+# include <linux/io_uring.h>
+# include <sys/syscall.h>
+# include <sys/mman.h>
+# include <sys/sysmacros.h>
+# include <fcntl.h>
+# ifdef __NR_io_uring_setup
+#  define USE_IO_URING 1
+# endif
+#endif
+
+/* update_file() asks for the modification time of each file it visits, one
+   at a time.  On network file systems every one of those stat() calls is a
+   round trip, so a build that has nothing to do can spend most of its time
+   waiting on them.  With --stat-threads=N we first walk the whole graph
+   below the goals and stat() every file name in it, the directories they
+   are in, and, for the files that don't exist, the names VPATH would try
+   instead.  name_mtime(), selective_vpath_search() and find_directory()
+   then take each result from here instead of asking the system again.
+
+   Where the kernel supports it the requests are queued to an io_uring and
+   reaped in batches, so the kernel works on many of them at once while we
+   make only a few system calls.  Otherwise they are made from N threads.
+
+   Each result is used at most once, and they are all dropped as soon as
+   the first recipe is started or file touched: from then on any file may
+   change under us, so we go to the file system as usual.  A prefetched
+   result is thus only ever used where make would have seen the
+   same thing.  */
+
+struct prefetch_ent
+  {
+    const char *name;           /* Name of the file.  */
+    time_t mtime;               /* Its status, if RESULT is 0.  */
+    long mtime_ns;
+    dev_t dev;
+    ino_t ino;
+    mode_t mode;
+    int result;                 /* What stat() returned.  */
+    int err;                    /* The errno stat() set, if RESULT isn't 0.  */
+    unsigned int used:1;        /* Nonzero if given to prefetched_stat().  */
+    unsigned int vpath:1;       /* Nonzero if VPATH is searched if missing.  */
+  };
+
+static unsigned long
+prefetch_ent_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((const struct prefetch_ent *) key)->name);
+}
+
+static unsigned long
+prefetch_ent_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((const struct prefetch_ent *) key)->name);
+}
+
+static int
+prefetch_ent_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (((const struct prefetch_ent *) x)->name,
+                         ((const struct prefetch_ent *) y)->name);
+}
+
+static struct hash_table prefetched;
+
+/* The entries to stat(), in the order they were found.  */
+static struct prefetch_ent **prefetch_list = 0;
+static unsigned int prefetch_count = 0;
+static unsigned int prefetch_size = 0;
+
+/* Index of the next entry to stat().  */
+static unsigned int prefetch_next = 0;
+
+/* Number of stat() calls saved.  */
+static unsigned int prefetch_used = 0;
+
+/* Nonzero between prefetch_mtimes() and prefetch_finish().  */
+static int prefetching = 0;
+
+#ifdef HAVE_PTHREADS
+static pthread_mutex_t prefetch_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Number of entries a thread claims at a time.  */
+#define PREFETCH_CHUNK 32
+
+/* Enter the cached name NAME, unless it is there already.  Return the new
+   entry, or NULL if there was one.  */
+
+static struct prefetch_ent *
+prefetch_enter (const char *name)
+{
+  struct prefetch_ent key;
+  struct prefetch_ent *ent;
+  void **slot;
+
+  key.name = name;
+  slot = hash_find_slot (&prefetched, &key);
+  if (! HASH_VACANT (*slot))
+    return 0;
+
+  ent = xcalloc (sizeof (struct prefetch_ent));
+  ent->name = name;
+  hash_insert_at (&prefetched, ent, slot);
+
+  return ent;
+}
+
+/* Add ENT to the list of names to stat().  */
+
+static void
+prefetch_queue (struct prefetch_ent *ent)
+{
+  if (prefetch_count == prefetch_size)
+    {
+      prefetch_size = prefetch_size ? prefetch_size * 2 : 1024;
+      prefetch_list = xrealloc (prefetch_list, prefetch_size
+                                * sizeof (struct prefetch_ent *));
+    }
+  prefetch_list[prefetch_count++] = ent;
+}
+
+/* Add the first LENGTH characters of NAME to the list of names to stat().  */
+
+void
+prefetch_name (const char *name, unsigned int length)
+{
+  struct prefetch_ent *ent;
+
+  if (! prefetching)
+    return;
+
+  ent = prefetch_enter (strcache_add_len (name, length));
+  if (ent != 0)
+    prefetch_queue (ent);
+}
+
+/* Add the directory find_directory() would be asked about for the file
+   NAME to the list of names to stat().  */
+
+static void
+prefetch_dir (const char *name)
+{
+  const char *slash = strrchr (name, '/');
+
+  if (slash == 0)
+    prefetch_name (".", 1);
+  else if (slash == name)
+    prefetch_name ("/", 1);
+  else
+    prefetch_name (name, slash - name);
+}
+
+/* Add FILE and everything it depends on to the list of names to stat().  */
+
+static void
+prefetch_add (struct file *file)
+{
+  struct prefetch_ent *ent;
+  struct file *f;
+  struct dep *d;
+
+  check_renamed (file);
+
+  ent = prefetch_enter (file->name);
+  if (ent == 0)
+    return;
+
+  /* Files whose time is known already or doesn't matter are entered only
+     so we don't visit them again.  */
+  if (file->phony || file->last_mtime != UNKNOWN_MTIME
+#ifndef NO_ARCHIVES
+      || ar_name (file->name)
+#endif
+      )
+    ent->used = 1;
+  else
+    {
+      ent->vpath = ! file->ignore_vpath;
+      prefetch_queue (ent);
+    }
+
+  for (f = file->double_colon ? file->double_colon : file; f != 0;
+       f = f->prev)
+    for (d = f->deps; d != 0; d = d->next)
+      if (d->file != 0)
+        prefetch_add (d->file);
+}
+
+/* stat() the name in ENT.  */
+
+static void
+prefetch_stat (struct prefetch_ent *ent)
+{
+  struct stat st;
+
+  EINTRLOOP (ent->result, stat (ent->name, &st));
+  if (ent->result == 0)
+    {
+      ent->mtime = st.st_mtime;
+#ifdef ST_MTIM_NSEC
+      ent->mtime_ns = st.ST_MTIM_NSEC;
+#else
+      ent->mtime_ns = 0;
+#endif
+      ent->dev = st.st_dev;
+      ent->ino = st.st_ino;
+      ent->mode = st.st_mode;
+    }
+  else
+    ent->err = errno;
+}
+
+/* stat() the entries not yet claimed by another thread.  */
+
+static void *
+prefetch_worker (void *arg UNUSED)
+{
+  while (1)
+    {
+      unsigned int i, end;
+
+#ifdef HAVE_PTHREADS
+      pthread_mutex_lock (&prefetch_lock);
+#endif
+      i = prefetch_next;
+      end = i + PREFETCH_CHUNK < prefetch_count
+            ? i + PREFETCH_CHUNK : prefetch_count;
+      prefetch_next = end;
+#ifdef HAVE_PTHREADS
+      pthread_mutex_unlock (&prefetch_lock);
+#endif
+
+      if (i == end)
+        break;
+
+      for (; i < end; ++i)
+        prefetch_stat (prefetch_list[i]);
+    }
+
+  return 0;
+}
+
+#ifdef USE_IO_URING
+
+/* Number of statx() requests queued to the kernel at a time.  */
+#define PREFETCH_RING 256
+
+struct prefetch_ring
+  {
+    int fd;
+    unsigned int entries;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    void *cq_map;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+  };
+
+static void
+ring_close (struct prefetch_ring *r)
+{
+  if (r->sq_map != MAP_FAILED)
+    munmap (r->sq_map, r->sq_size);
+  if (r->cq_map != MAP_FAILED)
+    munmap (r->cq_map, r->cq_size);
+  if (r->sqes != MAP_FAILED)
+    munmap (r->sqes, r->sqes_size);
+  close (r->fd);
+}
+
+/* Set up the io_uring R.  Return zero if the kernel won't give us one.  */
+
+static int
+ring_open (struct prefetch_ring *r)
+{
+  struct io_uring_params p;
+  char *sq, *cq;
+
+  memset (&p, 0, sizeof (p));
+  r->fd = syscall (__NR_io_uring_setup, PREFETCH_RING, &p);
+  if (r->fd < 0)
+    return 0;
+
+  r->entries = p.sq_entries;
+  r->sq_size = p.sq_off.array + p.sq_entries * sizeof (unsigned int);
+  r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  r->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+
+  r->sq_map = mmap (0, r->sq_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  r->cq_map = mmap (0, r->cq_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+  r->sqes = mmap (0, r->sqes_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (r->sq_map == MAP_FAILED || r->cq_map == MAP_FAILED
+      || r->sqes == MAP_FAILED)
+    {
+      ring_close (r);
+      return 0;
+    }
+
+  sq = r->sq_map;
+  cq = r->cq_map;
+  r->sq_tail = (unsigned int *) (sq + p.sq_off.tail);
+  r->sq_mask = (unsigned int *) (sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned int *) (sq + p.sq_off.array);
+  r->cq_head = (unsigned int *) (cq + p.cq_off.head);
+  r->cq_tail = (unsigned int *) (cq + p.cq_off.tail);
+  r->cq_mask = (unsigned int *) (cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+  return 1;
+}
+
+/* statx() the entries from prefetch_next on through an io_uring, a ring
+   full at a time.  Return zero if io_uring can't be used; the entries not
+   done yet are then still there from prefetch_next on.  */
+
+static int
+prefetch_uring (void)
+{
+  struct prefetch_ring r;
+  struct statx *bufs;
+
+  if (! ring_open (&r))
+    return 0;
+
+  bufs = xmalloc (r.entries * sizeof (struct statx));
+
+  while (prefetch_next < prefetch_count)
+    {
+      unsigned int n = prefetch_count - prefetch_next;
+      unsigned int tail = *r.sq_tail;
+      unsigned int submitted = 0;
+      unsigned int done = 0;
+      unsigned int i;
+
+      if (n > r.entries)
+        n = r.entries;
+
+      for (i = 0; i < n; ++i)
+        {
+          unsigned int idx = tail++ & *r.sq_mask;
+          struct io_uring_sqe *sqe = &r.sqes[idx];
+
+          memset (sqe, 0, sizeof (*sqe));
+          sqe->opcode = IORING_OP_STATX;
+          sqe->fd = AT_FDCWD;
+          sqe->addr = (unsigned long) prefetch_list[prefetch_next + i]->name;
+          sqe->len = STATX_TYPE | STATX_MODE | STATX_INO | STATX_MTIME;
+          sqe->off = (unsigned long) &bufs[i];
+          sqe->user_data = i;
+          r.sq_array[idx] = idx;
+        }
+      __atomic_store_n (r.sq_tail, tail, __ATOMIC_RELEASE);
+
+      while (done < n)
+        {
+          unsigned int head, ctail;
+          int e;
+
+          e = syscall (__NR_io_uring_enter, r.fd, n - submitted, n - done,
+                       IORING_ENTER_GETEVENTS, NULL, 0);
+          if (e < 0 && errno != EINTR)
+            {
+              /* Requests may still be in flight: leave their buffers to
+                 them, and do this batch over without the ring.  */
+              DB (DB_VERBOSE, (_("Cannot use io_uring: %s\n"),
+                               strerror (errno)));
+              ring_close (&r);
+              return 0;
+            }
+          if (e > 0)
+            submitted += e;
+
+          head = *r.cq_head;
+          ctail = __atomic_load_n (r.cq_tail, __ATOMIC_ACQUIRE);
+          for (; head != ctail; ++head, ++done)
+            {
+              struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+              unsigned int j = (unsigned int) cqe->user_data;
+              struct prefetch_ent *ent = prefetch_list[prefetch_next + j];
+
+              if (cqe->res == 0)
+                {
+                  ent->result = 0;
+                  ent->mtime = bufs[j].stx_mtime.tv_sec;
+                  ent->mtime_ns = bufs[j].stx_mtime.tv_nsec;
+                  ent->dev = makedev (bufs[j].stx_dev_major,
+                                      bufs[j].stx_dev_minor);
+                  ent->ino = bufs[j].stx_ino;
+                  ent->mode = bufs[j].stx_mode;
+                }
+              else if (cqe->res == -EINVAL)
+                /* A kernel that doesn't know IORING_OP_STATX.  */
+                prefetch_stat (ent);
+              else
+                {
+                  ent->result = -1;
+                  ent->err = -cqe->res;
+                }
+            }
+          __atomic_store_n (r.cq_head, head, __ATOMIC_RELEASE);
+        }
+
+      prefetch_next += n;
+    }
+
+  free (bufs);
+  ring_close (&r);
+
+  return 1;
+}
+
+#endif /* USE_IO_URING */
+
+/* stat() the entries from prefetch_next on.  Return the number of threads
+   used, or 0 if an io_uring was.  */
+
+static unsigned int
+prefetch_run (void)
+{
+  unsigned int nthreads = 1;
+  unsigned int pending = prefetch_count - prefetch_next;
+#ifdef HAVE_PTHREADS
+  unsigned int i;
+  pthread_t *threads;
+  sigset_t all, saved;
+#endif
+
+#ifdef USE_IO_URING
+  if (prefetch_uring ())
+    return 0;
+  pending = prefetch_count - prefetch_next;
+#endif
+
+#ifdef HAVE_PTHREADS
+  if (stat_threads > 1 && pending > PREFETCH_CHUNK)
+    {
+      nthreads = stat_threads;
+      if (nthreads > pending / PREFETCH_CHUNK)
+        nthreads = pending / PREFETCH_CHUNK;
+    }
+
+  /* Make sure the helpers never handle our signals.  */
+  sigfillset (&all);
+  pthread_sigmask (SIG_BLOCK, &all, &saved);
+
+  threads = xmalloc (nthreads * sizeof (pthread_t));
+  for (i = 1; i < nthreads; ++i)
+    if (pthread_create (&threads[i], NULL, prefetch_worker, NULL) != 0)
+      break;
+  nthreads = i;
+
+  pthread_sigmask (SIG_SETMASK, &saved, NULL);
+#endif
+
+  prefetch_worker (NULL);
+
+#ifdef HAVE_PTHREADS
+  for (i = 1; i < nthreads; ++i)
+    pthread_join (threads[i], NULL);
+  free (threads);
+#endif
+
+  return nthreads;
+}
+
+/* Find every file the GOALS depend on and stat() them all, together with
+   the directories they are in and the places VPATH would look for those
+   that are missing.  */
+
+void
+prefetch_mtimes (struct dep *goals)
+{
+  unsigned int nthreads;
+  unsigned int i, n;
+
+  hash_init (&prefetched, 1000, prefetch_ent_hash_1, prefetch_ent_hash_2,
+             prefetch_ent_hash_cmp);
+  prefetching = 1;
+
+  for (; goals != 0; goals = goals->next)
+    if (goals->file != 0)
+      prefetch_add (goals->file);
+
+  n = prefetch_count;
+  for (i = 0; i < n; ++i)
+    prefetch_dir (prefetch_list[i]->name);
+
+  nthreads = prefetch_run ();
+
+  /* Only now do we know which files VPATH will be searched for.  */
+  for (i = 0; i < n; ++i)
+    {
+      struct prefetch_ent *ent = prefetch_list[i];
+
+      if (ent->vpath && ent->result != 0
+          && (ent->err == ENOENT || ent->err == ENOTDIR))
+        vpath_prefetch (ent->name);
+    }
+
+  if (prefetch_next < prefetch_count)
+    prefetch_run ();
+
+  if (nthreads == 0)
+    DB (DB_BASIC, (_("Prefetched status of %u files using io_uring.\n"),
+                   prefetch_count));
+  else
+    DB (DB_BASIC, (_("Prefetched status of %u files using %u threads.\n"),
+                   prefetch_count, nthreads));
+}
+
+/* If the status of NAME was prefetched and hasn't been used yet, store
+   what stat() returned in *RESULTP, set errno or the st_dev, st_ino and
+   st_mode members of *ST (the only ones filled in) and the modification
+   time in *MTIMEP, if it isn't null, accordingly, and return nonzero.  */
+
+int
+prefetched_stat (const char *name, struct stat *st, FILE_TIMESTAMP *mtimep,
+                 int *resultp)
+{
+  struct prefetch_ent key;
+  struct prefetch_ent *ent;
+
+  if (! prefetching)
+    return 0;
+
+  key.name = name;
+  ent = hash_find_item (&prefetched, &key);
+  if (ent == 0 || ent->used)
+    return 0;
+
+  ent->used = 1;
+  ++prefetch_used;
+
+  *resultp = ent->result;
+  if (ent->result == 0)
+    {
+      st->st_dev = ent->dev;
+      st->st_ino = ent->ino;
+      st->st_mode = ent->mode;
+
+      /* This may complain about the time, so it isn't done in the threads.  */
+      if (mtimep != 0)
+        *mtimep = file_timestamp_cons (name, ent->mtime, ent->mtime_ns);
+    }
+  else
+    errno = ent->err;
+
+  return 1;
+}
+
+/* Forget the prefetched results.  */
+
+void
+prefetch_finish (void)
+{
+  if (! prefetching)
+    return;
+
+  DB (DB_BASIC, (_("Prefetched %u file stats; %u of them were used.\n"),
+                 prefetch_count, prefetch_used));
+
+  hash_free (&prefetched, 1);
+  free (prefetch_list);
+  prefetch_list = 0;
+  prefetching = 0;
+  prefetch_count = prefetch_size = prefetch_next = 0;
+}
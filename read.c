@@ -31,6 +31,23 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include <pwd.h>
 
+#ifdef HAVE_PTHREADS
+# include <pthread.h>
+# include <fcntl.h>
+#endif
+
+#if defined (HAVE_MMAP) && defined (HAVE_SYS_MMAN_H)
+# include <sys/mman.h>
+# if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#  define MAP_ANONYMOUS MAP_ANON
+# endif
+/* Makefiles are only mapped where a SIGBUS from one truncated while it is
+   read can be handled (see mapped_makefile_sigbus).  */
+# if defined(SA_SIGINFO) && defined(MAP_ANONYMOUS)
+#  define MAP_MAKEFILES 1
+# endif
+#endif
+
 /* A 'struct ebuffer' controls the origin of the makefile we are currently
    eval'ing.
 */
@@ -42,6 +59,9 @@ struct ebuffer
     char *bufstart;     /* Start of the entire buffer.  */
     unsigned int size;  /* Malloc'd size of buffer. */
     FILE *fp;           /* File, or NULL if this is an internal buffer.  */
+    char *map;          /* The file mapped in memory, or NULL.  */
+    size_t mapsize;     /* Size of the file mapped.  */
+    struct ebuffer *mapped_prev; /* The makefile mapped before this one.  */
     gmk_floc floc;   /* Info on the file in fp (if any).  */
   };
 
@@ -117,8 +137,19 @@ static struct dep *read_files = 0;
 
 static int eval_makefile (const char *filename, int flags);
 static void eval (struct ebuffer *buffer, int flags);
+struct dep_prescan;
+static int eval_dep_makefile (struct ebuffer *ebuf, const char *filename,
+                              struct dep_prescan *ps, int cacheable);
+static int prescan_start (struct nameseq *files);
+static struct dep_prescan *prescan_take (const char *name);
+static void prescan_release (struct dep_prescan *ps);
+static void prescan_finish (void);
+static void record_dep_rules (char *rules, unsigned int len,
+                              const gmk_floc *flocp);
 
 static long readline (struct ebuffer *ebuf);
+static void map_makefile (struct ebuffer *ebuf);
+static void unmap_makefile (struct ebuffer *ebuf);
 static void do_undefine (char *name, enum variable_origin origin,
                          struct ebuffer *ebuf);
 static struct variable *do_define (char *name, enum variable_origin origin,
@@ -286,6 +317,18 @@ restore_conditionals (struct conditionals *saved)
   conditionals = saved;
 }
 
+/* Return nonzero if the makefile read with FLAGS may be handled as a
+   dependency makefile (see scan_dep_makefile) rather than by eval().  */
+
+static int
+dep_makefile_ok (int flags)
+{
+  return (ANY_SET (flags, RM_INCLUDED)
+          && cmd_prefix == RECIPEPREFIX_DEFAULT
+          && (ANY_SET (flags, RM_NO_DEFAULT_GOAL)
+              || default_goal_var->value[0] != '\0'));
+}
+
 static int
 eval_makefile (const char *filename, int flags)
 {
@@ -293,10 +336,15 @@ eval_makefile (const char *filename, int flags)
   struct ebuffer ebuf;
   const gmk_floc *curfile;
   char *expanded = 0;
+  const char *cached = 0;
+  unsigned int cached_len = 0;
+  struct dep_prescan *ps;
+  int searched = 0;
   int makefile_errno;
 
   ebuf.floc.filenm = filename; /* Use the original file name.  */
   ebuf.floc.lineno = 1;
+  ebuf.map = 0;
 
   if (ISDB (DB_VERBOSE))
     {
@@ -312,6 +360,13 @@ eval_makefile (const char *filename, int flags)
       puts ("...");
     }
 
+  trace_begin ("parse", filename, 0);
+  STATS_START (STATS_PARSE);
+  STATS_COUNT (STATS_MAKEFILES);
+
+  /* If another thread has been scanning this makefile, wait for it.  */
+  ps = prescan_take (filename);
+
   /* First, get a stream to read.  */
 
   /* Expand ~ in FILENAME unless it came from 'include',
@@ -323,38 +378,52 @@ eval_makefile (const char *filename, int flags)
         filename = expanded;
     }
 
-  ENULLLOOP (ebuf.fp, fopen (filename, "r"));
-
-  /* Save the error code so we print the right message later.  */
-  makefile_errno = errno;
+  /* If the rules of this makefile are in the dependency cache and it hasn't
+     changed since, we don't need to read it at all.  */
+  if (depcache_file != 0 && dep_makefile_ok (flags))
+    cached = depcache_lookup (filename, &cached_len);
 
-  /* Check for unrecoverable errors: out of mem or FILE slots.  */
-  switch (makefile_errno)
+  if (cached)
     {
-    case EMFILE:
-    case ENFILE:
-    case ENOMEM:
-      {
-        const char *err = strerror (makefile_errno);
-        OS (fatal, reading_file, "%s", err);
-      }
+      ebuf.fp = 0;
+      makefile_errno = 0;
     }
-
-  /* If the makefile wasn't found and it's either a makefile from
-     the 'MAKEFILES' variable or an included makefile,
-     search the included makefile search path for this makefile.  */
-  if (ebuf.fp == 0 && (flags & RM_INCLUDED) && *filename != '/')
+  else
     {
-      unsigned int i;
-      for (i = 0; include_directories[i] != 0; ++i)
+      ENULLLOOP (ebuf.fp, fopen (filename, "r"));
+
+      /* Save the error code so we print the right message later.  */
+      makefile_errno = errno;
+
+      /* Check for unrecoverable errors: out of mem or FILE slots.  */
+      switch (makefile_errno)
         {
-          const char *included = concat (3, include_directories[i],
-                                         "/", filename);
-          ebuf.fp = fopen (included, "r");
-          if (ebuf.fp)
+        case EMFILE:
+        case ENFILE:
+        case ENOMEM:
+          {
+            const char *err = strerror (makefile_errno);
+            OS (fatal, reading_file, "%s", err);
+          }
+        }
+
+      /* If the makefile wasn't found and it's either a makefile from
+         the 'MAKEFILES' variable or an included makefile,
+         search the included makefile search path for this makefile.  */
+      if (ebuf.fp == 0 && (flags & RM_INCLUDED) && *filename != '/')
+        {
+          unsigned int i;
+          for (i = 0; include_directories[i] != 0; ++i)
             {
-              filename = included;
-              break;
+              const char *included = concat (3, include_directories[i],
+                                             "/", filename);
+              ebuf.fp = fopen (included, "r");
+              if (ebuf.fp)
+                {
+                  filename = included;
+                  searched = 1;
+                  break;
+                }
             }
         }
     }
@@ -379,39 +448,67 @@ eval_makefile (const char *filename, int flags)
 
   /* If the makefile can't be found at all, give up entirely.  */
 
-  if (ebuf.fp == 0)
+  if (ebuf.fp == 0 && cached == 0)
     {
       /* If we did some searching, errno has the error from the last
          attempt, rather from FILENAME itself.  Restore it in case the
          caller wants to use it in a message.  */
+      prescan_release (ps);
       errno = makefile_errno;
+      STATS_STOP (STATS_PARSE);
+      trace_end (0);
       return 0;
     }
 
   /* Set close-on-exec to avoid leaking the makefile to children, such as
      $(shell ...).  */
-  CLOSE_ON_EXEC (fileno (ebuf.fp));
+  if (ebuf.fp)
+    CLOSE_ON_EXEC (fileno (ebuf.fp));
 
   /* Add this makefile to the list. */
   do_variable_definition (&ebuf.floc, "MAKEFILE_LIST", filename, o_file,
                           f_append, 0);
 
-  /* Evaluate the makefile */
-  ebuf.size = 200;
-  ebuf.buffer = ebuf.bufnext = ebuf.bufstart = xmalloc (ebuf.size);
-
   curfile = reading_file;
   reading_file = &ebuf.floc;
 
-  eval (&ebuf, !(flags & RM_NO_DEFAULT_GOAL));
+  if (cached)
+    {
+      char *rules = xmalloc (cached_len);
+
+      DB (DB_VERBOSE, (_("Using cached rules for makefile '%s'.\n"),
+                       filename));
+      memcpy (rules, cached, cached_len);
+      record_dep_rules (rules, cached_len, &ebuf.floc);
+      free (rules);
+    }
+  else
+    {
+      ebuf.size = 200;
+      ebuf.buffer = ebuf.bufnext = ebuf.bufstart = xmalloc (ebuf.size);
+      map_makefile (&ebuf);
+
+      /* Evaluate the makefile, unless it is a dependency makefile.  */
+      if (! dep_makefile_ok (flags)
+          || ! eval_dep_makefile (&ebuf, filename, searched ? 0 : ps,
+                                  depcache_file != 0 && !searched))
+        eval (&ebuf, !(flags & RM_NO_DEFAULT_GOAL));
+
+      unmap_makefile (&ebuf);
+      free (ebuf.bufstart);
+    }
 
   reading_file = curfile;
 
-  fclose (ebuf.fp);
+  prescan_release (ps);
+  if (ebuf.fp)
+    fclose (ebuf.fp);
 
-  free (ebuf.bufstart);
   alloca (0);
 
+  STATS_STOP (STATS_PARSE);
+  trace_end (0);
+
   return 1;
 }
 
@@ -428,6 +525,7 @@ eval_buffer (char *buffer, const gmk_floc *floc)
   ebuf.size = strlen (buffer);
   ebuf.buffer = ebuf.bufnext = ebuf.bufstart = buffer;
   ebuf.fp = NULL;
+  ebuf.map = NULL;
 
   if (floc)
     ebuf.floc = *floc;
@@ -831,6 +929,7 @@ eval (struct ebuffer *ebuf, int set_default)
           /* "-include" (vs "include") says no error if the file does not
              exist.  "sinclude" is an alias for this from SGI.  */
           int noerror = (p[0] != 'i');
+          int prescanning;
 
           /* Include ends the previous rule.  */
           record_waiting_files ();
@@ -858,7 +957,9 @@ eval (struct ebuffer *ebuf, int set_default)
              the default goal before those in the included makefile.  */
           record_waiting_files ();
 
-          /* Read each included makefile.  */
+          /* Read each included makefile.  Those that may be dependency
+             makefiles can be scanned ahead by other threads.  */
+          prescanning = prescan_start (files);
           while (files != 0)
             {
               struct nameseq *next = files->next;
@@ -879,6 +980,9 @@ eval (struct ebuffer *ebuf, int set_default)
                 }
             }
 
+          if (prescanning)
+            prescan_finish ();
+
           /* Restore conditional state.  */
           restore_conditionals (save);
 
@@ -1320,6 +1424,630 @@ eval (struct ebuffer *ebuf, int set_default)
 }
 
 
+/* Dependency makefiles.
+
+   Makefiles written by compilers (gcc -MD and friends) contain nothing but
+   rules without recipes: "target...: prereq...", often continued over
+   several lines.  scan_dep_makefile() recognizes such makefiles and reduces
+   them to one line per rule:
+
+     <lineno> <target>...:<prereq>...
+
+   with the words separated by single spaces.  record_dep_rules() records
+   rules in that form directly with record_files(), skipping eval()
+   altogether.  Every included makefile is scanned this way first, straight
+   from its map if it could be mapped, and the dependency cache (depcache.c)
+   keeps the rules across runs.
+
+   Anything that might need the full parser makes the scan fail: variable
+   references, assignments, directives, recipes, semicolons, patterns,
+   wildcards, archive members, double-colon rules and backslash quoting.  */
+
+/* Words that may start a directive rather than a rule.  */
+
+static const char *const dep_directives[] =
+  {
+    "define", "endef", "undefine", "ifdef", "ifndef", "ifeq", "ifneq",
+    "else", "endif", "include", "-include", "sinclude", "load", "-load",
+    "export", "unexport", "override", "private", "vpath", 0
+  };
+
+static int
+dep_directive_p (const char *word, unsigned int len)
+{
+  const char *const *d;
+
+  for (d = dep_directives; *d != 0; ++d)
+    if (strlen (*d) == len && strneq (*d, word, len))
+      return 1;
+
+  return 0;
+}
+
+/* Characters that end a word in a dependency makefile, or make the scan
+   fail.  */
+
+static char dep_char_map[UCHAR_MAX + 1];
+
+static void
+dep_char_map_init (void)
+{
+  const char *c;
+
+  for (c = " \t\n:#\\$=;%*?[()~\r"; *c != '\0'; ++c)
+    dep_char_map[(unsigned char) *c] = 1;
+  dep_char_map[0] = 1;
+}
+
+/* Scan the LEN bytes at BUF.  If they are a dependency makefile return the
+   reduced rules, setting *LENP to their length; the result is malloc'd.
+   Otherwise return NULL.  */
+
+static char *
+scan_dep_makefile (const char *buf, unsigned int len, unsigned int *lenp)
+{
+  const char *p = buf;
+  const char *end = buf + len;
+  unsigned long lineno = 1;
+  unsigned int osize = len + 64;
+  unsigned int olen = 0;
+  char *out;
+
+  if (dep_char_map[0] == 0)
+    dep_char_map_init ();
+
+  /* Leave a UTF-8 BOM to eval().  */
+  if (len >= 3 && p[0] == (char)0xEF && p[1] == (char)0xBB
+      && p[2] == (char)0xBF)
+    return 0;
+
+  out = xmalloc (osize);
+
+  while (p < end)
+    {
+      unsigned int start = olen;
+      unsigned int body;
+      int colon = 0;
+      int ntargets = 0;
+      int nprereqs = 0;
+
+      /* A line starting with the recipe prefix is a recipe.  This is only
+         used while that is the default (see dep_makefile_ok), and other
+         threads may be scanning while eval() changes cmd_prefix.  */
+      if (*p == RECIPEPREFIX_DEFAULT)
+        goto fail;
+
+      if (olen + INTSTR_LENGTH + 2 > osize)
+        {
+          osize = (olen + INTSTR_LENGTH + 2) * 2;
+          out = xrealloc (out, osize);
+        }
+      olen += sprintf (&out[olen], "%lu ", lineno);
+      body = olen;
+
+      /* Collect the words of one logical line.  */
+      while (1)
+        {
+          const char *w;
+
+          /* Skip blanks and backslash/newlines.  */
+          while (p < end)
+            {
+              if (*p == ' ' || *p == '\t')
+                ++p;
+              else if (*p == '\\' && p + 1 < end && p[1] == '\n')
+                {
+                  p += 2;
+                  ++lineno;
+                }
+              else
+                break;
+            }
+
+          if (p == end)
+            break;
+
+          if (*p == '\n')
+            {
+              ++p;
+              ++lineno;
+              break;
+            }
+
+          /* A comment runs to the end of the logical line.  */
+          if (*p == '#')
+            {
+              while (p < end && *p != '\n')
+                {
+                  if (*p == '\\' && p + 1 < end
+                      && (p[1] == '\\' || p[1] == '\n'))
+                    {
+                      if (p[1] == '\n')
+                        ++lineno;
+                      ++p;
+                    }
+                  ++p;
+                }
+              continue;
+            }
+
+          if (*p == ':')
+            {
+              if (colon || ntargets == 0)
+                goto fail;
+              colon = 1;
+              out[olen++] = ':';
+              ++p;
+              continue;
+            }
+
+          /* Find the end of this word.  Most characters are ordinary, so
+             skip those a whole run at a time.  */
+          w = p;
+          while (p < end)
+            {
+              while (p < end && ! dep_char_map[(unsigned char) *p])
+                ++p;
+              if (p == end)
+                break;
+
+              switch (*p)
+                {
+                case ' ': case '\t': case '\n': case ':': case '#':
+                  break;
+                case '\\':
+                  if (p + 1 < end && p[1] == '\n')
+                    break;
+                  goto fail;
+                case '$': case '=': case ';': case '%': case '*': case '?':
+                case '[': case '(': case ')': case '~': case '\r': case '\0':
+                  goto fail;
+                default:
+                  ++p;
+                  continue;
+                }
+              break;
+            }
+
+          if (!colon)
+            {
+              if (ntargets == 0 && dep_directive_p (w, p - w))
+                goto fail;
+              ++ntargets;
+            }
+          else
+            {
+              if ((p - w == 6 && strneq (w, "define", 6))
+                  || (p - w == 8 && strneq (w, "undefine", 8)))
+                goto fail;
+              ++nprereqs;
+            }
+
+          if (olen + (p - w) + 2 > osize)
+            {
+              osize = (olen + (p - w) + 2) * 2;
+              out = xrealloc (out, osize);
+            }
+          if (olen > body && out[olen - 1] != ':')
+            out[olen++] = ' ';
+          memcpy (&out[olen], w, p - w);
+          olen += p - w;
+        }
+
+      /* Blank lines and comments leave no trace.  */
+      if (ntargets == 0)
+        {
+          olen = start;
+          continue;
+        }
+
+      if (!colon)
+        goto fail;
+
+      out[olen++] = '\n';
+    }
+
+  *lenp = olen;
+  return out;
+
+ fail:
+  free (out);
+  return 0;
+}
+
+/* Record the LEN bytes of RULES, in the form made by scan_dep_makefile(),
+   as read from the makefile at FLOCP.  RULES is modified.  */
+
+static void
+record_dep_rules (char *rules, unsigned int len, const gmk_floc *flocp)
+{
+  char *p = rules;
+  char *end = rules + len;
+  gmk_floc fi;
+
+  fi.filenm = flocp->filenm;
+
+  while (p < end)
+    {
+      struct nameseq *filenames;
+      char *eol = memchr (p, '\n', end - p);
+      char *colon;
+      char *depstr = 0;
+
+      *eol = '\0';
+      fi.lineno = strtoul (p, &p, 10);
+      ++p;
+
+      colon = strchr (p, ':');
+      *colon = '\0';
+      filenames = PARSE_SIMPLE_SEQ (&p, struct nameseq);
+
+      if (colon[1] != '\0')
+        depstr = xstrdup (colon + 1);
+
+      record_files (filenames, NULL, NULL, depstr, fi.lineno, NULL, 0, 0,
+                    cmd_prefix, &fi);
+
+      p = eol + 1;
+    }
+}
+
+/* Scanning dependency makefiles ahead.
+
+   With --parse-threads=N, when an include directive names several makefiles
+   other threads open and scan them with scan_dep_makefile(), in the order
+   they are named, while this one reads them.  Reading each makefile then
+   only takes what was found from the thread that scanned it, waiting for it
+   if need be, or scans it itself if no other thread has started to.
+
+   Everything else happens as if the makefile had been scanned when it is
+   read: whether it may be a dependency makefile at all (dep_makefile_ok),
+   opening it and searching the include directories for it, the dependency
+   cache, and recording its rules.  What a thread found is only used if the
+   makefile opened then is still the same file, of the same size and time,
+   as the one it scanned, since a makefile read earlier may have run
+   something that changed it.  */
+
+struct dep_prescan
+  {
+    const char *name;           /* Name of the makefile.  */
+    char *rules;                /* What scan_dep_makefile() made of it.  */
+    unsigned int rules_len;
+    struct stat st;             /* Its status when it was scanned.  */
+    int state;                  /* One of PRESCAN_* below.  */
+    int scanned;                /* Nonzero if it could be scanned.  */
+  };
+
+#define PRESCAN_QUEUED  0       /* No thread has started on it.  */
+#define PRESCAN_BUSY    1       /* A thread is scanning it.  */
+#define PRESCAN_DONE    2       /* It has been scanned.  */
+
+#ifdef HAVE_PTHREADS
+
+static struct dep_prescan *prescan_list = 0;
+static unsigned int prescan_count = 0;
+
+/* Index of the next entry to be read, and of the first one a thread may
+   still have to start on.  */
+static unsigned int prescan_next = 0;
+static unsigned int prescan_queued = 0;
+
+/* Nonzero once the threads should stop.  */
+static int prescan_stop = 0;
+
+static pthread_t *prescan_threads = 0;
+static unsigned int prescan_nthreads = 0;
+static pthread_mutex_t prescan_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prescan_done = PTHREAD_COND_INITIALIZER;
+
+/* Open and scan the makefile of PS.  This is done without the lock, and
+   touches nothing but PS.  */
+
+static void
+prescan_scan (struct dep_prescan *ps)
+{
+  char *buf;
+  ssize_t len = 0;
+  int fd;
+  int e;
+
+  EINTRLOOP (fd, open (ps->name, O_RDONLY));
+  if (fd < 0)
+    return;
+
+  EINTRLOOP (e, fstat (fd, &ps->st));
+  if (e != 0 || !S_ISREG (ps->st.st_mode))
+    {
+      close (fd);
+      return;
+    }
+
+  /* The file is read rather than mapped: the helpers block all signals, so
+     they could not survive the SIGBUS from a file truncated meanwhile.  */
+  buf = xmalloc (ps->st.st_size + 1);
+  while (len < ps->st.st_size)
+    {
+      ssize_t n;
+      EINTRLOOP (n, read (fd, buf + len, ps->st.st_size - len));
+      if (n <= 0)
+        break;
+      len += n;
+    }
+  if (len == ps->st.st_size)
+    {
+      ps->rules = scan_dep_makefile (buf, len, &ps->rules_len);
+      ps->scanned = 1;
+    }
+  free (buf);
+  close (fd);
+}
+
+/* Claim the first entry no thread has started on, with the lock held.  */
+
+static struct dep_prescan *
+prescan_claim (void)
+{
+  while (!prescan_stop && prescan_queued < prescan_count)
+    {
+      struct dep_prescan *ps = &prescan_list[prescan_queued++];
+      if (ps->state == PRESCAN_QUEUED)
+        {
+          ps->state = PRESCAN_BUSY;
+          return ps;
+        }
+    }
+
+  return 0;
+}
+
+static void *
+prescan_worker (void *arg UNUSED)
+{
+  struct dep_prescan *ps;
+
+  pthread_mutex_lock (&prescan_lock);
+  while ((ps = prescan_claim ()) != 0)
+    {
+      pthread_mutex_unlock (&prescan_lock);
+      prescan_scan (ps);
+      pthread_mutex_lock (&prescan_lock);
+      ps->state = PRESCAN_DONE;
+      pthread_cond_broadcast (&prescan_done);
+    }
+  pthread_mutex_unlock (&prescan_lock);
+
+  return 0;
+}
+
+/* Start threads scanning the makefiles in FILES, if there are several and
+   --parse-threads asks for it.  Return nonzero if they were started; then
+   prescan_finish() must be called once they have all been read.  */
+
+static int
+prescan_start (struct nameseq *files)
+{
+  struct nameseq *n;
+  unsigned int count = 0;
+  unsigned int i;
+  sigset_t all, saved;
+
+  /* Makefiles included while others are being scanned are not.  */
+  if (parse_threads < 2 || prescan_list != 0
+      || cmd_prefix != RECIPEPREFIX_DEFAULT)
+    return 0;
+
+  for (n = files; n != 0; n = n->next)
+    ++count;
+  if (count < 2)
+    return 0;
+
+  if (dep_char_map[0] == 0)
+    dep_char_map_init ();
+
+  prescan_list = xcalloc (count * sizeof (struct dep_prescan));
+  for (n = files; n != 0; n = n->next)
+    {
+      unsigned int len;
+
+      /* The rules of makefiles in the dependency cache need no scanning.  */
+      if (depcache_file != 0 && depcache_lookup (n->name, &len) != 0)
+        continue;
+      prescan_list[prescan_count++].name = n->name;
+    }
+  if (prescan_count < 2)
+    {
+      free (prescan_list);
+      prescan_list = 0;
+      prescan_count = 0;
+      return 0;
+    }
+  prescan_next = prescan_queued = 0;
+  prescan_stop = 0;
+
+  /* Make sure the helpers never handle our signals.  */
+  sigfillset (&all);
+  pthread_sigmask (SIG_BLOCK, &all, &saved);
+
+  prescan_nthreads = parse_threads - 1;
+  if (prescan_nthreads > prescan_count - 1)
+    prescan_nthreads = prescan_count - 1;
+  prescan_threads = xmalloc (prescan_nthreads * sizeof (pthread_t));
+  for (i = 0; i < prescan_nthreads; ++i)
+    if (pthread_create (&prescan_threads[i], NULL, prescan_worker, NULL) != 0)
+      break;
+  prescan_nthreads = i;
+
+  pthread_sigmask (SIG_SETMASK, &saved, NULL);
+
+  DB (DB_VERBOSE, (_("Scanning %u makefiles with %u threads.\n"),
+                   prescan_count, prescan_nthreads + 1));
+
+  return 1;
+}
+
+/* If NAME is the next makefile to be read of those being scanned, return
+   its entry once it has been scanned, or NULL.  The caller must give it to
+   prescan_release().  */
+
+static struct dep_prescan *
+prescan_take (const char *name)
+{
+  struct dep_prescan *ps;
+
+  if (prescan_list == 0 || prescan_next == prescan_count
+      || prescan_list[prescan_next].name != name)
+    return 0;
+
+  pthread_mutex_lock (&prescan_lock);
+  ps = &prescan_list[prescan_next++];
+  if (ps->state == PRESCAN_QUEUED)
+    {
+      /* No thread has got to it yet: scan it ourselves.  */
+      ps->state = PRESCAN_BUSY;
+      pthread_mutex_unlock (&prescan_lock);
+      prescan_scan (ps);
+      pthread_mutex_lock (&prescan_lock);
+      ps->state = PRESCAN_DONE;
+    }
+  while (ps->state != PRESCAN_DONE)
+    pthread_cond_wait (&prescan_done, &prescan_lock);
+  pthread_mutex_unlock (&prescan_lock);
+
+  return ps;
+}
+
+/* Free what was left of PS once its makefile has been read.  */
+
+static void
+prescan_release (struct dep_prescan *ps)
+{
+  if (ps != 0)
+    {
+      free (ps->rules);
+      ps->rules = 0;
+    }
+}
+
+/* Stop the threads and free what they found for makefiles not read.  */
+
+static void
+prescan_finish (void)
+{
+  unsigned int i;
+
+  pthread_mutex_lock (&prescan_lock);
+  prescan_stop = 1;
+  pthread_mutex_unlock (&prescan_lock);
+
+  for (i = 0; i < prescan_nthreads; ++i)
+    pthread_join (prescan_threads[i], NULL);
+  free (prescan_threads);
+  prescan_threads = 0;
+  prescan_nthreads = 0;
+
+  for (i = 0; i < prescan_count; ++i)
+    free (prescan_list[i].rules);
+  free (prescan_list);
+  prescan_list = 0;
+  prescan_count = 0;
+}
+
+#else /* !HAVE_PTHREADS */
+
+static int
+prescan_start (struct nameseq *files UNUSED)
+{
+  return 0;
+}
+
+static struct dep_prescan *
+prescan_take (const char *name UNUSED)
+{
+  return 0;
+}
+
+static void
+prescan_release (struct dep_prescan *ps UNUSED)
+{
+}
+
+static void
+prescan_finish (void)
+{
+}
+
+#endif /* !HAVE_PTHREADS */
+
+/* Return nonzero if what was found scanning PS may be used for the makefile
+   FILENAME, whose status is ST.  */
+
+static int
+prescan_valid (const struct dep_prescan *ps, const char *filename,
+               const struct stat *st)
+{
+  return (ps->scanned
+          && ps->st.st_dev == st->st_dev
+          && ps->st.st_ino == st->st_ino
+          && ps->st.st_size == st->st_size
+          && (FILE_TIMESTAMP_STAT_MODTIME (filename, ps->st)
+              == FILE_TIMESTAMP_STAT_MODTIME (filename, *st)));
+}
+
+/* Try to read the makefile open in EBUF as a dependency makefile.  If it is
+   one, record its rules and, if CACHEABLE, remember them in the dependency
+   cache under FILENAME; return nonzero.  If it isn't, return 0 so it can be
+   given to eval(), rewinding the stream if it was read.  If PS is not NULL,
+   it is what another thread found scanning the makefile, which is used if
+   the makefile hasn't changed since.  */
+
+static int
+eval_dep_makefile (struct ebuffer *ebuf, const char *filename,
+                   struct dep_prescan *ps, int cacheable)
+{
+  struct stat st;
+  char *rules;
+  unsigned int rules_len;
+  int e;
+
+  EINTRLOOP (e, fstat (fileno (ebuf->fp), &st));
+  if (e != 0 || !S_ISREG (st.st_mode))
+    return 0;
+
+  if (ps != 0 && prescan_valid (ps, filename, &st))
+    {
+      rules = ps->rules;
+      rules_len = ps->rules_len;
+      ps->rules = 0;
+    }
+  else if (ebuf->map)
+    rules = scan_dep_makefile (ebuf->map, ebuf->mapsize, &rules_len);
+  else
+    {
+      char *buf = xmalloc (st.st_size + 1);
+      unsigned int len = fread (buf, 1, st.st_size, ebuf->fp);
+
+      rules = ferror (ebuf->fp) ? 0 : scan_dep_makefile (buf, len, &rules_len);
+      free (buf);
+
+      if (rules == 0)
+        rewind (ebuf->fp);
+    }
+
+  if (rules == 0)
+    return 0;
+
+  STATS_COUNT (STATS_DEPFILES);
+
+  if (cacheable)
+    depcache_store (filename, &st, rules, rules_len);
+
+  record_dep_rules (rules, rules_len, &ebuf->floc);
+  free (rules);
+
+  return 1;
+}
+
+
 /* Remove comments from LINE.
    This is done by copying the text at LINE onto itself.  */
 
@@ -1800,9 +2528,9 @@ record_target_var (struct nameseq *filenames, char *defn,
              We don't want to just call enter_file() because that allocates a
              new entry if the file is a double-colon, which we don't want in
              this situation.  */
-          f = lookup_file (name);
+          f = lookup_cached_file (name);
           if (!f)
-            f = enter_file (strcache_add (name));
+            f = enter_file (name);
           else if (f->double_colon)
             f = f->double_colon;
 
@@ -1831,6 +2559,7 @@ record_target_var (struct nameseq *filenames, char *defn,
           if (gv && v != gv
               && (gv->origin == o_env_override || gv->origin == o_command))
             {
+              forget_compiled_value (v);
               free (v->value);
               v->value = xstrdup (gv->value);
               v->origin = gv->origin;
@@ -2056,7 +2785,7 @@ record_files (struct nameseq *filenames, const char *pattern,
       else
         {
           /* Double-colon.  Make a new record even if there already is one.  */
-          f = lookup_file (name);
+          f = lookup_cached_file (name);
 
           /* Check for both : and :: rules.  Check is_target so we don't lose
              on default suffix rules or makefiles.  */
@@ -2422,6 +3151,224 @@ readstring (struct ebuffer *ebuf)
   return 0;
 }
 
+#ifdef MAP_MAKEFILES
+
+/* The makefiles mapped while they are read, innermost first.  */
+static struct ebuffer *mapped_makefiles = 0;
+
+static long mapped_page_size;
+
+/* A makefile can be truncated while it is mapped, as a .d file remade by a
+   job running in parallel may be.  Touching its pages past the new end then
+   raises SIGBUS.  Put a page of zeros in place of the one touched, so that
+   readmapped() finds the text ends there, as a stream would.  A SIGBUS
+   anywhere else is fatal as usual.  */
+
+static void
+mapped_makefile_sigbus (int sig, siginfo_t *info, void *context)
+{
+  char *addr = info->si_addr;
+  struct ebuffer *ebuf;
+  struct sigaction sa;
+
+  (void) context;
+
+  for (ebuf = mapped_makefiles; ebuf != 0; ebuf = ebuf->mapped_prev)
+    if (addr >= ebuf->map && addr < ebuf->map + ebuf->mapsize)
+      {
+        char *page = addr - (addr - ebuf->map) % mapped_page_size;
+
+        if (mmap (page, mapped_page_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0)
+            != MAP_FAILED)
+          return;
+        break;
+      }
+
+  /* Not ours, or it could not be replaced: let it be raised again, and
+     kill us.  */
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = SIG_DFL;
+  sigemptyset (&sa.sa_mask);
+  sigaction (sig, &sa, NULL);
+}
+
+#endif /* MAP_MAKEFILES */
+
+/* Map the makefile open in EBUF into memory, if it is a regular file, so
+   readline() can leave its lines where they are instead of copying them.
+   The map is private: the lines are changed in place as they are read, and
+   only the pages changed are copied.
+
+   A makefile with a NUL character in it is not mapped: what readline()
+   does with NULs depends on how much it reads from the stream at a time,
+   and reading the makefile the same way keeps the same results.  */
+
+static void
+map_makefile (struct ebuffer *ebuf)
+{
+#ifdef MAP_MAKEFILES
+  struct stat st;
+  void *map;
+  int e;
+
+  EINTRLOOP (e, fstat (fileno (ebuf->fp), &st));
+  if (e != 0 || !S_ISREG (st.st_mode) || st.st_size == 0
+      || (off_t) (size_t) st.st_size != st.st_size)
+    return;
+
+  if (mapped_page_size == 0)
+    {
+      struct sigaction sa;
+
+      mapped_page_size = sysconf (_SC_PAGESIZE);
+      memset (&sa, 0, sizeof (sa));
+      sa.sa_sigaction = mapped_makefile_sigbus;
+      sa.sa_flags = SA_SIGINFO;
+      sigemptyset (&sa.sa_mask);
+      if (mapped_page_size <= 0 || sigaction (SIGBUS, &sa, NULL) != 0)
+        {
+          mapped_page_size = -1;
+          return;
+        }
+    }
+  else if (mapped_page_size < 0)
+    return;
+
+  map = mmap (0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+              fileno (ebuf->fp), 0);
+  if (map == MAP_FAILED)
+    return;
+
+  ebuf->map = ebuf->bufnext = map;
+  ebuf->mapsize = st.st_size;
+  ebuf->mapped_prev = mapped_makefiles;
+  mapped_makefiles = ebuf;
+
+  if (memchr (map, '\0', st.st_size) != 0)
+    {
+      unmap_makefile (ebuf);
+      ebuf->bufnext = ebuf->bufstart;
+      return;
+    }
+
+  STATS_COUNT (STATS_MAPPED);
+#else
+  (void) ebuf;
+#endif
+}
+
+/* Unmap the makefile mapped by map_makefile() in EBUF, if it was.  */
+
+static void
+unmap_makefile (struct ebuffer *ebuf)
+{
+#ifdef MAP_MAKEFILES
+  if (ebuf->map == 0)
+    return;
+
+  mapped_makefiles = ebuf->mapped_prev;
+  munmap (ebuf->map, ebuf->mapsize);
+  ebuf->map = 0;
+#else
+  (void) ebuf;
+#endif
+}
+
+/* Read a line from the makefile mapped in EBUF, as readline() does from a
+   stream.  The line is terminated where it is in the map, except for a last
+   line with no newline, which is copied to the buffer to make room for it.
+
+   The makefile had no NULs when it was mapped, so a NUL means it has been
+   truncated since (see mapped_makefile_sigbus): it ends there.  */
+
+static long
+readmapped (struct ebuffer *ebuf)
+{
+  char *start = ebuf->bufnext;
+  char *end = ebuf->map + ebuf->mapsize;
+  char *p = start;
+  char *eol = end;
+  char *next = end;
+  long nlines = 0;
+
+  if (start >= end)
+    return -1;
+
+  while (p < end)
+    {
+      char *nl = memchr (p, '\n', end - p);
+      int backslash = 0;
+      int cr = 0;
+      char *q;
+
+      if (nl == 0)
+        break;
+
+      ++nlines;
+
+#if !defined(WINDOWS32) && !defined(__MSDOS__) && !defined(__EMX__)
+      /* Check to see if the line was really ended with CRLF; if so ignore
+         the CR.  */
+      cr = nl > start && nl[-1] == '\r';
+#endif
+
+      for (q = nl - cr; q > start && q[-1] == '\\'; --q)
+        backslash = !backslash;
+
+      if (!backslash)
+        {
+          eol = nl - cr;
+          next = nl + 1;
+          break;
+        }
+
+      /* It was a backslash/newline combo.  If a CR came between them, move
+         what we have of the line over it.  */
+      if (cr)
+        {
+          memmove (start + 1, start, nl - 1 - start);
+          ++start;
+        }
+
+      p = nl + 1;
+    }
+
+  p = memchr (start, '\0', eol - start);
+  if (p != 0)
+    {
+      if (p == start)
+        {
+          ebuf->bufnext = end;
+          return -1;
+        }
+      eol = p;
+      next = end;
+    }
+
+  if (eol < end)
+    {
+      *eol = '\0';
+      ebuf->buffer = start;
+    }
+  else
+    {
+      unsigned int len = eol - start;
+
+      if (len >= ebuf->size)
+        {
+          ebuf->size = len + 1;
+          ebuf->bufstart = xrealloc (ebuf->bufstart, ebuf->size);
+        }
+      memcpy (ebuf->bufstart, start, len);
+      ebuf->bufstart[len] = '\0';
+      ebuf->buffer = ebuf->bufstart;
+    }
+  ebuf->bufnext = next;
+
+  return nlines ? nlines : 1;
+}
+
 static long
 readline (struct ebuffer *ebuf)
 {
@@ -2436,6 +3383,9 @@ readline (struct ebuffer *ebuf)
   if (!ebuf->fp)
     return readstring (ebuf);
 
+  if (ebuf->map)
+    return readmapped (ebuf);
+
   /* When reading from a file, we always start over at the beginning of the
      buffer for each new line.  */
 
@@ -2916,7 +3866,7 @@ parse_file_seq (char **stringp, unsigned int size, int stopmap,
   struct nameseq **newp = &new;
 #define NEWELT(_n)  do { \
                         const char *__n = (_n); \
-                        *newp = xcalloc (size); \
+                        *newp = alloc_ns (); \
                         (*newp)->name = (cachep ? strcache_add (__n) : xstrdup (__n)); \
                         newp = &(*newp)->next; \
                     } while(0)
@@ -2928,8 +3878,8 @@ parse_file_seq (char **stringp, unsigned int size, int stopmap,
   /* Always stop on NUL.  */
   stopmap |= MAP_NUL;
 
-  if (size < sizeof (struct nameseq))
-    size = sizeof (struct nameseq);
+  /* Elements come from the dep arena, which holds deps and nameseqs.  */
+  assert (size <= sizeof (struct dep));
 
   if (NONE_SET (flags, PARSEFS_NOGLOB))
     dir_setup_glob (&gl);
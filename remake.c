@@ -64,6 +64,25 @@ static void remake_file (struct file *file);
 static FILE_TIMESTAMP name_mtime (const char *name);
 static const char *library_search (const char *lib, FILE_TIMESTAMP *mtime_ptr);
 
+/* Each pass of update_goal_chain() used to consider the whole graph below the
+   goals again after every job that finished, although all but a few targets
+   could only find their prerequisites still being made.  So now a target
+   whose prerequisites are being made records itself in the 'waiters' list of
+   each of them and counts them in its 'pending' member, and it is not
+   considered again until the last of them has finished.  Then it is put on
+   the list of ready files, which update_goal_chain() considers directly.
+   The goals themselves are considered on every pass, as before.
+
+   This is not done while remaking makefiles, where how a target is
+   considered depends on the path it is reached by.  */
+
+/* Nonzero if targets wait for their prerequisites as described above.  */
+static int tracking_waiters = 0;
+
+/* The files to be considered again, in the order they became ready.  */
+static struct dep *ready_files = 0;
+static struct dep **ready_tail = &ready_files;
+
 
 /* Remake all the goals in the 'struct dep' chain GOALS.  Return -1 if nothing
    was done, 0 if all goals were updated successfully, or 1 if a goal failed.
@@ -100,19 +119,55 @@ update_goal_chain (struct dep *goals)
   /* All files start with the considered bit 0, so the global value is 1.  */
   considered = 1;
 
+  tracking_waiters = !rebuilding_makefiles;
+
   /* Update all the goals until they are all finished.  */
 
   while (goals != 0)
     {
       register struct dep *g, *lastgoal;
+      struct dep *ready;
+      int more_ready;
 
       /* Start jobs that are waiting for the load to go down.  */
 
       start_waiting_jobs ();
 
-      /* Wait for a child to die.  */
+      /* Start jobs found ready on the last pass (--schedule).  */
+
+      more_ready = start_ready_jobs ();
 
-      reap_children (1, 0);
+      /* Wait for a child to die, unless there is work to do already.  */
+
+      reap_children (ready_files == 0 && !more_ready, 0);
+
+      /* Consider the files whose prerequisites have all finished.  Files
+         that become ready meanwhile wait for the next pass, when they can't
+         have been considered already.  */
+
+      ready = ready_files;
+      ready_files = 0;
+      ready_tail = &ready_files;
+      while (ready != 0)
+        {
+          struct dep *next = ready->next;
+          struct file *file = ready->file;
+
+          file->ready = 0;
+          if (file->command_state == cs_deps_running && file->pending == 0)
+            {
+              /* Force update_file() to consider it and not prune it.  */
+              if (file->double_colon)
+                file->double_colon->considered = !considered;
+              else
+                file->considered = !considered;
+
+              update_file (file, file->wait_depth);
+            }
+
+          free_dep (ready);
+          ready = next;
+        }
 
       lastgoal = 0;
       g = goals;
@@ -235,7 +290,7 @@ update_goal_chain (struct dep *goals)
                 lastgoal->next = g->next;
 
               /* Free the storage.  */
-              free (g);
+              free_dep (g);
 
               g = lastgoal == 0 ? goals : lastgoal->next;
 
@@ -262,8 +317,153 @@ update_goal_chain (struct dep *goals)
       just_print_flag = n;
     }
 
+  while (ready_files != 0)
+    {
+      struct dep *next = ready_files->next;
+      ready_files->file->ready = 0;
+      free_dep (ready_files);
+      ready_files = next;
+    }
+  ready_tail = &ready_files;
+  tracking_waiters = 0;
+
   return status;
 }
+
+/* Put FILE on the list of files to be considered again.  Goals are left
+   out: the goal chain considers them on every pass anyway.  */
+
+static void
+make_ready (struct file *file)
+{
+  struct dep *d;
+
+  if (file->ready || file->wait_depth == 0)
+    return;
+
+  d = alloc_dep ();
+  d->file = file;
+  *ready_tail = d;
+  ready_tail = &d->next;
+  file->ready = 1;
+}
+
+/* Record that FILE waits for DEP, which is being made.  Return zero if DEP
+   will not tell FILE when it is done: it is an intermediate file whose
+   prerequisites finished since FILE's walk checked it, so FILE must look at
+   it again instead.  */
+
+static int
+wait_for (struct file *file, struct file *dep)
+{
+  struct dep *w;
+
+  if (dep->command_state == cs_deps_running && dep->pending == 0
+      && !dep->ready)
+    {
+      /* Nothing DEP waits for is left to finish; it must be considered
+         again before it can go on.  */
+      if (dep->wait_through)
+        return 0;
+      make_ready (dep);
+    }
+
+  w = alloc_dep ();
+  w->file = file;
+  w->next = dep->waiters;
+  dep->waiters = w;
+  ++file->pending;
+
+  return 1;
+}
+
+/* Make FILE wait for each of DEPS (or any of their double-colon entries)
+   that is being made.  Return zero if one of them won't tell FILE when it
+   is done.  */
+
+static int
+wait_for_prereqs (struct file *file, struct dep *deps)
+{
+  struct dep *d;
+  int settled = 1;
+
+  for (d = deps; d != 0; d = d->next)
+    {
+      struct file *f = d->file->double_colon ? d->file->double_colon : d->file;
+      int finished = 0;
+
+      do
+        {
+          if (f->command_state == cs_running
+              || f->command_state == cs_deps_running)
+            {
+              if (! wait_for (file, f))
+                settled = 0;
+            }
+          else if (finished && f->command_state == cs_not_started)
+            /* This double-colon rule is yet to be started; nothing will
+               tell FILE when it is done.  */
+            settled = 0;
+          finished |= f->command_state == cs_finished;
+          f = f->prev;
+        }
+      while (f != 0);
+    }
+
+  return settled;
+}
+
+/* FILE, considered at DEPTH, found some of its prerequisites (or those of
+   its also_make files) being made.  Make it wait for them.  */
+
+static void
+wait_for_deps (struct file *file, unsigned int depth)
+{
+  struct dep *ad;
+  int settled;
+
+  file->wait_depth = depth;
+  file->wait_through = 0;
+
+  settled = wait_for_prereqs (file, file->deps);
+  for (ad = file->also_make; ad != 0; ad = ad->next)
+    if (! wait_for_prereqs (file, ad->file->deps))
+      settled = 0;
+
+  /* If they all finished already, or some won't say when they have,
+     FILE must be considered again by itself.  */
+  if (file->pending == 0 || ! settled)
+    make_ready (file);
+}
+
+/* FILE no longer needs waiting for: tell those that wait for it.  A file
+   that has no more prerequisites to wait for is made ready, or, if it is an
+   intermediate file that was waiting only on behalf of its dependents,
+   passes the news on to them.  */
+
+static void
+notify_waiters (struct file *file)
+{
+  struct dep *w = file->waiters;
+
+  file->waiters = 0;
+  while (w != 0)
+    {
+      struct dep *next = w->next;
+      struct file *f = w->file;
+
+      if (f->pending > 0 && --f->pending == 0)
+        {
+          if (f->wait_through)
+            notify_waiters (f);
+          else
+            make_ready (f);
+        }
+
+      free_dep (w);
+      w = next;
+    }
+}
 
 /* If FILE is not up to date, execute the commands for it.
    Return 0 if successful, non-0 if unsuccessful;
@@ -298,7 +498,13 @@ update_file (struct file *file, unsigned int depth)
             && !f->dontcare && f->no_diag))
         {
           DBF (DB_VERBOSE, _("Pruning file '%s'.\n"));
-          return f->command_state == cs_finished ? f->update_status : 0;
+
+          /* A later double-colon entry may have been considered from the
+             ready list and failed, so report the worst of them all.  */
+          for (; f != 0; f = f->prev)
+            if (f->command_state == cs_finished && f->update_status > status)
+              status = f->update_status;
+          return status;
         }
     }
 
@@ -445,8 +651,14 @@ update_file_1 (struct file *file, unsigned int depth)
 
   switch (file->command_state)
     {
-    case cs_not_started:
     case cs_deps_running:
+      if (file->pending > 0)
+        {
+          DBF (DB_VERBOSE, _("The prerequisites of '%s' are being made.\n"));
+          return 0;
+        }
+      break;
+    case cs_not_started:
       break;
     case cs_running:
       DBF (DB_VERBOSE, _("Still updating file '%s'.\n"));
@@ -582,12 +794,18 @@ update_file_1 (struct file *file, unsigned int depth)
 
           {
             register struct file *f = d->file;
+            int finished = 0;
             if (f->double_colon)
               f = f->double_colon;
             do
               {
+                /* A double-colon rule that hasn't been started although
+                   an earlier one has finished is still to be run.  */
                 running |= (f->command_state == cs_running
-                            || f->command_state == cs_deps_running);
+                            || f->command_state == cs_deps_running
+                            || (finished
+                                && f->command_state == cs_not_started));
+                finished |= f->command_state == cs_finished;
                 f = f->prev;
               }
             while (f != 0);
@@ -646,12 +864,16 @@ update_file_1 (struct file *file, unsigned int depth)
 
             {
               register struct file *f = d->file;
+              int finished = 0;
               if (f->double_colon)
                 f = f->double_colon;
               do
                 {
                   running |= (f->command_state == cs_running
-                              || f->command_state == cs_deps_running);
+                              || f->command_state == cs_deps_running
+                              || (finished
+                                  && f->command_state == cs_not_started));
+                  finished |= f->command_state == cs_finished;
                   f = f->prev;
                 }
               while (f != 0);
@@ -675,6 +897,8 @@ update_file_1 (struct file *file, unsigned int depth)
     {
       set_command_state (file, cs_deps_running);
       --depth;
+      if (tracking_waiters)
+        wait_for_deps (file, depth);
       DBF (DB_VERBOSE, _("The prerequisites of '%s' are being made.\n"));
       return 0;
     }
@@ -991,6 +1215,11 @@ notice_finished_file (struct file *file)
     /* Nothing was done for FILE, but it needed nothing done.
        So mark it now as "succeeded".  */
     file->update_status = us_success;
+
+  /* Let the files waiting for FILE and its also_make's go on.  */
+  notify_waiters (file);
+  for (d = file->also_make; d != 0; d = d->next)
+    notify_waiters (d->file);
 }
 
 /* Check whether another file (whose mtime is THIS_MTIME) needs updating on
@@ -1053,6 +1282,10 @@ check_dep (struct file *file, unsigned int depth,
         /* If the intermediate file actually exists and is newer, then we
            should remake from it.  */
         *must_make_ptr = 1;
+      else if (file->pending > 0)
+        /* Its prerequisites are still being made; nothing has changed
+           since we last looked.  */
+        DBF (DB_VERBOSE, _("The prerequisites of '%s' are being made.\n"));
       else
         {
           /* Otherwise, update all non-intermediate files we depend on, if
@@ -1121,10 +1354,23 @@ check_dep (struct file *file, unsigned int depth,
             }
 
           if (deps_running)
-            /* Record that some of FILE's deps are still being made.
-               This tells the upper levels to wait on processing it until the
-               commands are finished.  */
-            set_command_state (file, cs_deps_running);
+            {
+              /* Record that some of FILE's deps are still being made.
+                 This tells the upper levels to wait on processing it until
+                 the commands are finished.  */
+              set_command_state (file, cs_deps_running);
+
+              /* FILE waits for them only so that its dependents know when
+                 to look at it again.  */
+              if (tracking_waiters)
+                {
+                  for (d = file->deps; d != 0; d = d->next)
+                    if (d->file->command_state == cs_running
+                        || d->file->command_state == cs_deps_running)
+                      wait_for (file, d->file);
+                  file->wait_through = 1;
+                }
+            }
         }
     }
 
@@ -1149,6 +1395,8 @@ touch_file (struct file *file)
   if (just_print_flag)
     return us_success;
 
+  prefetch_finish ();
+
 #ifndef NO_ARCHIVES
   if (ar_name (file->name))
     return ar_touch (file->name) ? us_failed : us_success;
@@ -1447,15 +1695,23 @@ name_mtime (const char *name)
   struct stat st;
   int e;
 
-  EINTRLOOP (e, stat (name, &st));
-  if (e == 0)
-    mtime = FILE_TIMESTAMP_STAT_MODTIME (name, st);
-  else if (errno == ENOENT || errno == ENOTDIR)
-    mtime = NONEXISTENT_MTIME;
-  else
+  if (! prefetched_stat (name, &st, &mtime, &e))
+    {
+      STATS_START (STATS_STAT);
+      EINTRLOOP (e, stat (name, &st));
+      STATS_STOP (STATS_STAT);
+      STATS_COUNT (STATS_STATS);
+      if (e == 0)
+        mtime = FILE_TIMESTAMP_STAT_MODTIME (name, st);
+    }
+  if (e != 0)
     {
-      perror_with_name ("stat: ", name);
-      return NONEXISTENT_MTIME;
+      if (errno != ENOENT && errno != ENOTDIR)
+        {
+          perror_with_name ("stat: ", name);
+          return NONEXISTENT_MTIME;
+        }
+      mtime = NONEXISTENT_MTIME;
     }
 
   /* If we get here we either found it, or it doesn't exist.
@@ -1483,7 +1739,10 @@ name_mtime (const char *name)
           long llen;
           char *p;
 
+          STATS_START (STATS_STAT);
           EINTRLOOP (e, lstat (lpath, &st));
+          STATS_STOP (STATS_STAT);
+          STATS_COUNT (STATS_STATS);
           if (e)
             {
               /* Just take what we have so far.  */
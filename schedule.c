@@ -0,0 +1,327 @@
+/* Critical-path job scheduling for GNU Make.
+Copyright (C) 2015 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+#include "filedef.h"
+#include "dep.h"
+#include "hash.h"
+#include "debug.h"
+
+/* With --schedule=critical-path, jobs that are ready to run are started in
+   order of the time their targets have left to the goals: the time their own
+   recipe takes plus the longest chain of recipes that must run after it.
+   Those times come from a history file written by the previous make.
+
+   The history file is text: a header line, then for each target a line
+
+     <msecs> <path> <name>
+
+   where MSECS is how long the recipe for NAME took when it last ran, and PATH
+   is its time to the goals as of the last make that ran anything.  */
+
+#define SCHEDULE_HEADER "# GNU make schedule history, version 1\n"
+
+struct schedule_ent
+  {
+    const char *name;           /* Name of the target.  */
+    unsigned long msecs;        /* Time its recipe took.  */
+    unsigned long path;         /* Time from its start to the goals.  */
+    struct file *file;          /* The file, if reached from the goals.  */
+    unsigned int ran:1;         /* Nonzero if MSECS was measured this run.  */
+    unsigned int visited:1;     /* Nonzero if reached from the goals.  */
+  };
+
+static unsigned long
+schedule_ent_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((const struct schedule_ent *) key)->name);
+}
+
+static unsigned long
+schedule_ent_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((const struct schedule_ent *) key)->name);
+}
+
+static int
+schedule_ent_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (((const struct schedule_ent *) x)->name,
+                         ((const struct schedule_ent *) y)->name);
+}
+
+static struct hash_table schedule_times;
+
+/* Nonzero once schedule_load() has been called.  */
+static int schedule_loaded = 0;
+
+/* Nonzero if some recipe was timed this run.  */
+static int schedule_dirty = 0;
+
+/* Parse a decimal number at *PP, followed by a single space.  */
+
+static int
+schedule_number (char **pp, unsigned long *np)
+{
+  char *p = *pp;
+
+  if (! ISDIGIT (*p))
+    return 0;
+
+  errno = 0;
+  *np = strtoul (p, &p, 10);
+  if (errno != 0 || *p != ' ')
+    return 0;
+
+  *pp = p + 1;
+  return 1;
+}
+
+/* Return the history entry for NAME, creating it if CREATE is nonzero.  */
+
+static struct schedule_ent *
+schedule_lookup (const char *name, int create)
+{
+  struct schedule_ent key;
+  struct schedule_ent **slot;
+  struct schedule_ent *ent;
+
+  key.name = name;
+  slot = (struct schedule_ent **) hash_find_slot (&schedule_times, &key);
+  ent = *slot;
+  if (! HASH_VACANT (ent))
+    return ent;
+  if (! create)
+    return 0;
+
+  ent = xcalloc (sizeof (struct schedule_ent));
+  ent->name = strcache_add (name);
+  hash_insert_at (&schedule_times, ent, slot);
+  return ent;
+}
+
+/* Read the history in FILE.  If it is damaged, start with an empty one.  */
+
+void
+schedule_load (const char *file)
+{
+  char *contents, *p, *end;
+  size_t len;
+
+  hash_init (&schedule_times, 1000, schedule_ent_hash_1,
+             schedule_ent_hash_2, schedule_ent_hash_cmp);
+  schedule_loaded = 1;
+
+  contents = read_cache_file (file, &len);
+  if (contents == 0)
+    {
+      DB (DB_VERBOSE, (_("No schedule history '%s' found.\n"), file));
+      return;
+    }
+
+  p = contents;
+  end = p + len;
+
+  if (len < CSTRLEN (SCHEDULE_HEADER)
+      || ! strneq (p, SCHEDULE_HEADER, CSTRLEN (SCHEDULE_HEADER)))
+    goto damaged;
+  p += CSTRLEN (SCHEDULE_HEADER);
+
+  while (p < end)
+    {
+      struct schedule_ent *ent;
+      unsigned long msecs, path;
+      char *name;
+
+      if (! schedule_number (&p, &msecs) || ! schedule_number (&p, &path))
+        goto damaged;
+
+      name = p;
+      p = strchr (p, '\n');
+      if (p == 0 || p == name)
+        goto damaged;
+      *(p++) = '\0';
+
+      ent = schedule_lookup (name, 1);
+      ent->msecs = msecs;
+      ent->path = path;
+    }
+
+  DB (DB_VERBOSE, (_("Read schedule history '%s' (%lu entries).\n"),
+                   file, schedule_times.ht_fill));
+  free (contents);
+  return;
+
+ damaged:
+  DB (DB_BASIC, (_("Ignoring damaged schedule history '%s'.\n"), file));
+  hash_free (&schedule_times, 1);
+  hash_init (&schedule_times, 1000, schedule_ent_hash_1,
+             schedule_ent_hash_2, schedule_ent_hash_cmp);
+  free (contents);
+}
+
+/* Return a clock in milliseconds, for timing recipes.  */
+
+unsigned long
+schedule_clock (void)
+{
+  int resolution;
+  FILE_TIMESTAMP now = file_timestamp_now (&resolution);
+
+  return ((unsigned long) FILE_TIMESTAMP_S (now) * 1000
+          + FILE_TIMESTAMP_NS (now) / 1000000);
+}
+
+/* Return the priority of starting the recipe for FILE: its time to the goals
+   according to the history, or zero if it has none.  */
+
+unsigned long
+schedule_priority (const struct file *file)
+{
+  struct schedule_ent *ent;
+
+  if (! schedule_loaded)
+    return 0;
+
+  ent = schedule_lookup (file->name, 0);
+  return ent ? ent->path : 0;
+}
+
+/* Note that the recipe for FILE took MSECS milliseconds.  The recipes of
+   double-colon rules for the same target add up.  */
+
+void
+schedule_record (const struct file *file, unsigned long msecs)
+{
+  struct schedule_ent *ent;
+
+  if (! schedule_loaded || just_print_flag || question_flag || touch_flag)
+    return;
+
+  ent = schedule_lookup (file->name, 1);
+  if (! ent->ran)
+    ent->msecs = 0;
+  ent->msecs += msecs;
+  ent->ran = 1;
+
+  schedule_dirty = 1;
+}
+
+/* Append the entries of FILE and everything it depends on to the array
+   *ORDERP, which has room for *SIZEP entries and holds *NP of them, each
+   after all of its prerequisites.  */
+
+static void
+schedule_visit (struct file *file, struct schedule_ent ***orderp,
+                unsigned int *sizep, unsigned int *np)
+{
+  struct schedule_ent *ent;
+  struct file *f;
+  struct dep *d;
+
+  if (file->double_colon)
+    file = file->double_colon;
+
+  ent = schedule_lookup (file->name, 1);
+  if (ent->visited)
+    return;
+  ent->visited = 1;
+  ent->file = file;
+
+  for (f = file; f != 0; f = f->prev)
+    for (d = f->deps; d != 0; d = d->next)
+      schedule_visit (d->file, orderp, sizep, np);
+
+  if (*np == *sizep)
+    {
+      *sizep = *sizep ? *sizep * 2 : 256;
+      *orderp = xrealloc (*orderp, *sizep * sizeof (struct schedule_ent *));
+    }
+  (*orderp)[(*np)++] = ent;
+}
+
+/* Write one history entry to the FILE * in ARG.  Files reached from the
+   goals are only kept if they have a recipe; others are kept as they were,
+   since a later make may have other goals.  */
+
+static void
+schedule_write_ent (const void *item, void *arg)
+{
+  const struct schedule_ent *ent = item;
+  FILE *fp = arg;
+
+  if (ent->visited && ent->file->cmds == 0 && ent->msecs == 0)
+    return;
+
+  fprintf (fp, "%lu %lu %s\n", ent->msecs, ent->path, ent->name);
+}
+
+/* Write the whole history to FP.  */
+
+static void
+schedule_write (FILE *fp)
+{
+  fputs (SCHEDULE_HEADER, fp);
+  hash_map_arg (&schedule_times, schedule_write_ent, fp);
+}
+
+/* Work out the time to GOALS of every target they depend on, and write the
+   history back to FILE if any recipe was timed.  */
+
+void
+schedule_save (const char *file, struct dep *goals)
+{
+  struct schedule_ent **order = 0;
+  unsigned int size = 0, n = 0, i;
+  struct dep *g;
+
+  if (! schedule_loaded || ! schedule_dirty)
+    return;
+
+  for (g = goals; g != 0; g = g->next)
+    schedule_visit (g->file, &order, &size, &n);
+
+  for (i = 0; i < n; ++i)
+    order[i]->path = order[i]->msecs;
+
+  /* Going backwards each target comes before its prerequisites, so its time
+     to the goals is final by the time theirs are worked out from it.  */
+  for (i = n; i-- > 0; )
+    {
+      struct schedule_ent *ent = order[i];
+      struct file *f;
+      struct dep *d;
+
+      for (f = ent->file; f != 0; f = f->prev)
+        for (d = f->deps; d != 0; d = d->next)
+          {
+            struct file *df = d->file->double_colon
+                              ? d->file->double_colon : d->file;
+            struct schedule_ent *dent = schedule_lookup (df->name, 0);
+
+            if (dent->path < dent->msecs + ent->path)
+              dent->path = dent->msecs + ent->path;
+          }
+    }
+  free (order);
+
+  if (replace_cache_file (file, schedule_write))
+    {
+      DB (DB_VERBOSE, (_("Wrote schedule history '%s' (%lu entries).\n"),
+                       file, schedule_times.ht_fill));
+      schedule_dirty = 0;
+    }
+}
@@ -0,0 +1,420 @@
+/* Cache of shell function results for GNU Make.
+Copyright (C) 2015 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+#include "filedef.h"
+#include "hash.h"
+#include "variable.h"
+#include "debug.h"
+
+/* $(cached-shell FILES,COMMAND) gives the same result as $(shell COMMAND),
+   but remembers it in a cache file, .make-shell-cache or the file given with
+   --shell-cache=FILE.  Later makes reuse the result without running COMMAND
+   as long as it is run from the same directory with the same shell and
+   flags, the files in FILES have the same size and modification time, and
+   the environment variables named in .SHELL_CACHE_ENV (PATH if it is not
+   set) have the same values.  Only results of commands that succeed are
+   kept.
+
+   The cache is text: a header line, then for each command a line
+
+     C <command length> <key length> <output length>
+
+   followed by the command, the key, the output and a newline.  The key
+   describes the directory, shell, files and variables the result depends
+   on.  Only the latest
+   result for each command is kept.  */
+
+#define SHELLCACHE_HEADER "# GNU make shell cache, version 1\n"
+
+struct shellcache_ent
+  {
+    char *command;              /* The command.  */
+    char *key;                  /* What its output depended on.  */
+    unsigned int key_len;
+    char *output;               /* Its output, as the shell function gave.  */
+    unsigned int output_len;
+  };
+
+static unsigned long
+shellcache_ent_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((const struct shellcache_ent *) key)->command);
+}
+
+static unsigned long
+shellcache_ent_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((const struct shellcache_ent *) key)->command);
+}
+
+static int
+shellcache_ent_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (((const struct shellcache_ent *) x)->command,
+                         ((const struct shellcache_ent *) y)->command);
+}
+
+static struct hash_table shellcache;
+
+/* Nonzero once the cache file has been read.  */
+static int shellcache_loaded = 0;
+
+/* Nonzero if the cache must be written out again.  */
+static int shellcache_dirty = 0;
+
+/* Parse a decimal number at *PP, followed by a single space or newline.  */
+
+static int
+shellcache_number (char **pp, unsigned long *np)
+{
+  char *p = *pp;
+
+  if (! ISDIGIT (*p))
+    return 0;
+
+  errno = 0;
+  *np = strtoul (p, &p, 10);
+  if (errno != 0 || (*p != ' ' && *p != '\n'))
+    return 0;
+
+  *pp = p + 1;
+  return 1;
+}
+
+/* Return a copy of the LEN bytes at P, with a null after them.  */
+
+static char *
+shellcache_copy (const char *p, unsigned int len)
+{
+  char *s = xmalloc (len + 1);
+  memcpy (s, p, len);
+  s[len] = '\0';
+  return s;
+}
+
+static void
+shellcache_free_ent (const void *item)
+{
+  struct shellcache_ent *ent = (struct shellcache_ent *) item;
+
+  free (ent->command);
+  free (ent->key);
+  free (ent->output);
+  free (ent);
+}
+
+/* Read the cache.  If it is damaged, start with an empty one.  */
+
+static void
+shellcache_load (void)
+{
+  char *contents, *p, *end;
+  size_t len;
+
+  hash_init (&shellcache, 100, shellcache_ent_hash_1, shellcache_ent_hash_2,
+             shellcache_ent_hash_cmp);
+  shellcache_loaded = 1;
+
+  if (! shellcache_file)
+    shellcache_file = xstrdup (".make-shell-cache");
+
+  contents = read_cache_file (shellcache_file, &len);
+  if (contents == 0)
+    {
+      DB (DB_VERBOSE, (_("No shell cache '%s' found.\n"), shellcache_file));
+      return;
+    }
+
+  p = contents;
+  end = p + len;
+
+  if (len < CSTRLEN (SHELLCACHE_HEADER)
+      || ! strneq (p, SHELLCACHE_HEADER, CSTRLEN (SHELLCACHE_HEADER)))
+    goto damaged;
+  p += CSTRLEN (SHELLCACHE_HEADER);
+
+  while (p < end)
+    {
+      struct shellcache_ent *ent, *old;
+      unsigned long clen, klen, olen;
+
+      if (p[0] != 'C' || p[1] != ' ')
+        goto damaged;
+      p += 2;
+
+      /* Check each length by itself first, so the sum can't overflow.  */
+      if (! shellcache_number (&p, &clen) || ! shellcache_number (&p, &klen)
+          || ! shellcache_number (&p, &olen) || p[-1] != '\n'
+          || clen > UINT_MAX || klen > UINT_MAX || olen > UINT_MAX
+          || clen >= (unsigned long) (end - p)
+          || klen >= (unsigned long) (end - p)
+          || olen >= (unsigned long) (end - p)
+          || clen + klen + olen >= (unsigned long) (end - p)
+          || p[clen + klen + olen] != '\n')
+        goto damaged;
+
+      ent = xmalloc (sizeof (struct shellcache_ent));
+      ent->command = shellcache_copy (p, clen);
+      p += clen;
+      ent->key = shellcache_copy (p, klen);
+      ent->key_len = klen;
+      p += klen;
+      ent->output = shellcache_copy (p, olen);
+      ent->output_len = olen;
+      p += olen + 1;
+
+      /* A later entry for the same command replaces an earlier one.  */
+      old = hash_insert (&shellcache, ent);
+      if (old)
+        shellcache_free_ent (old);
+    }
+
+  DB (DB_VERBOSE, (_("Read shell cache '%s' (%lu entries).\n"),
+                   shellcache_file, shellcache.ht_fill));
+  free (contents);
+  return;
+
+ damaged:
+  DB (DB_BASIC, (_("Ignoring damaged shell cache '%s'.\n"), shellcache_file));
+  hash_map (&shellcache, shellcache_free_ent);
+  hash_free (&shellcache, 0);
+  hash_init (&shellcache, 100, shellcache_ent_hash_1, shellcache_ent_hash_2,
+             shellcache_ent_hash_cmp);
+  free (contents);
+  shellcache_dirty = 1;
+}
+
+/* Return the key describing the directory a command is run in, ARGV, the
+   shell and flags make runs it with, the FILES it depends on and the
+   environment variables it is run with, and set *LENP to its length.
+   Return null if some file changed so recently it might still be changing
+   without its time moving on: then the result must not be kept.  */
+
+char *
+shellcache_key (const char *files, char **argv, unsigned int *lenp)
+{
+  const char *p;
+  char *vars;
+  char *key;
+  unsigned int len = 0, size = 256;
+  unsigned int l;
+  time_t now = time (0);
+  int ok = 1;
+
+  key = xmalloc (size);
+
+#define ADD_TO_KEY(_s, _l)                              \
+  do {                                                  \
+    if (len + (_l) + 1 > size)                          \
+      {                                                 \
+        size = (len + (_l) + 1) * 2;                    \
+        key = xrealloc (key, size);                     \
+      }                                                 \
+    memcpy (key + len, (_s), (_l));                     \
+    len += (_l);                                        \
+  } while (0)
+
+  /* Relative names in FILES are relative to the directory, too.  */
+  ADD_TO_KEY ("D ", 2);
+  if (starting_directory)
+    ADD_TO_KEY (starting_directory, strlen (starting_directory));
+  ADD_TO_KEY ("\n", 1);
+
+  for (; *argv != 0; ++argv)
+    {
+      char buf[INTSTR_LENGTH + 4];
+
+      l = strlen (*argv);
+      sprintf (buf, "A %u ", l);
+      ADD_TO_KEY (buf, strlen (buf));
+      ADD_TO_KEY (*argv, l);
+      ADD_TO_KEY ("\n", 1);
+    }
+
+  while ((p = find_next_token (&files, &l)) != 0)
+    {
+      char *name = shellcache_copy (p, l);
+      char buf[3 * INTSTR_LENGTH + 8];
+      struct stat st;
+      int e;
+
+      EINTRLOOP (e, stat (name, &st));
+      if (e != 0)
+        strcpy (buf, " -\n");
+      else
+        {
+          if ((unsigned long) st.st_mtime + 1 >= (unsigned long) now)
+            ok = 0;
+          sprintf (buf, " %lu %lu %lu\n",
+                   (unsigned long) st.st_mtime,
+                   (unsigned long) STAT_MTIME_NS (st),
+                   (unsigned long) st.st_size);
+        }
+
+      ADD_TO_KEY ("F ", 2);
+      ADD_TO_KEY (name, l);
+      ADD_TO_KEY (buf, strlen (buf));
+      free (name);
+    }
+
+  {
+    /* Turn off --warn-undefined-variables while we expand the list.  */
+    int save = warn_undefined_variables_flag;
+    struct variable *v;
+
+    warn_undefined_variables_flag = 0;
+    v = lookup_variable (STRING_SIZE_TUPLE (".SHELL_CACHE_ENV"));
+    vars = allocated_variable_expand (v ? "$(.SHELL_CACHE_ENV)" : "PATH");
+    warn_undefined_variables_flag = save;
+  }
+
+  {
+    const char *list = vars;
+
+    while ((p = find_next_token (&list, &l)) != 0)
+      {
+        char *name = shellcache_copy (p, l);
+        const char *value = getenv (name);
+
+        ADD_TO_KEY ("E ", 2);
+        ADD_TO_KEY (name, l);
+        if (value)
+          {
+            ADD_TO_KEY ("=", 1);
+            ADD_TO_KEY (value, strlen (value));
+          }
+        ADD_TO_KEY ("\n", 1);
+        free (name);
+      }
+  }
+  free (vars);
+
+#undef ADD_TO_KEY
+
+  key[len] = '\0';
+  *lenp = len;
+
+  if (! ok)
+    {
+      free (key);
+      return 0;
+    }
+  return key;
+}
+
+/* If the cache has the output of COMMAND run when the files and variables
+   it depends on were as KEY, of length KEY_LEN, describes, return it and set
+   *LENP to its length.  Otherwise return null.  */
+
+const char *
+shellcache_lookup (const char *command, const char *key, unsigned int key_len,
+                   unsigned int *lenp)
+{
+  struct shellcache_ent k;
+  struct shellcache_ent *ent;
+
+  if (! shellcache_loaded)
+    shellcache_load ();
+
+  k.command = (char *) command;
+  ent = hash_find_item (&shellcache, &k);
+  if (ent == 0 || ent->key_len != key_len
+      || memcmp (ent->key, key, key_len) != 0)
+    return 0;
+
+  DB (DB_VERBOSE, (_("Using cached output of '%s'.\n"), command));
+  *lenp = ent->output_len;
+  return ent->output;
+}
+
+/* Remember OUTPUT, LEN bytes long, as the output of COMMAND when the files
+   and variables it depends on were as KEY describes.  */
+
+void
+shellcache_store (const char *command, const char *key, unsigned int key_len,
+                  const char *output, unsigned int len)
+{
+  struct shellcache_ent k;
+  struct shellcache_ent **slot;
+  struct shellcache_ent *ent;
+
+  if (! shellcache_loaded)
+    shellcache_load ();
+
+  k.command = (char *) command;
+  slot = (struct shellcache_ent **) hash_find_slot (&shellcache, &k);
+  ent = *slot;
+  if (HASH_VACANT (ent))
+    {
+      ent = xmalloc (sizeof (struct shellcache_ent));
+      ent->command = xstrdup (command);
+      hash_insert_at (&shellcache, ent, slot);
+    }
+  else
+    {
+      free (ent->key);
+      free (ent->output);
+    }
+
+  ent->key = shellcache_copy (key, key_len);
+  ent->key_len = key_len;
+  ent->output = shellcache_copy (output, len);
+  ent->output_len = len;
+
+  shellcache_dirty = 1;
+}
+
+/* Write one cache entry to the FILE * in ARG.  */
+
+static void
+shellcache_write_ent (const void *item, void *arg)
+{
+  const struct shellcache_ent *ent = item;
+  FILE *fp = arg;
+  unsigned int clen = strlen (ent->command);
+
+  fprintf (fp, "C %u %u %u\n", clen, ent->key_len, ent->output_len);
+  fwrite (ent->command, 1, clen, fp);
+  fwrite (ent->key, 1, ent->key_len, fp);
+  fwrite (ent->output, 1, ent->output_len, fp);
+  putc ('\n', fp);
+}
+
+/* Write the whole cache to FP.  */
+
+static void
+shellcache_write (FILE *fp)
+{
+  fputs (SHELLCACHE_HEADER, fp);
+  hash_map_arg (&shellcache, shellcache_write_ent, fp);
+}
+
+/* Write the cache back, if anything changed.  */
+
+void
+shellcache_save (void)
+{
+  if (! shellcache_loaded || ! shellcache_dirty)
+    return;
+
+  if (replace_cache_file (shellcache_file, shellcache_write))
+    {
+      DB (DB_VERBOSE, (_("Wrote shell cache '%s' (%lu entries).\n"),
+                       shellcache_file, shellcache.ht_fill));
+      shellcache_dirty = 0;
+    }
+}
@@ -0,0 +1,528 @@
+/* Shell coprocesses for the shell function of GNU Make.
+Copyright (C) 2015 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+#include "job.h"
+#include "debug.h"
+
+#include <signal.h>
+
+/* With --shell-pool=N, $(shell ...) commands are not each run by a new shell
+   started for them.  Instead make keeps up to N shells running, one for each
+   SHELL the commands use, which read commands from a pipe.  Each command is
+   run in a subshell, with make's standard input, so it cannot change the
+   shell for later commands.
+
+   Each shell has a FIFO of its own, which it opens for each command to
+   write its output to, so make reads the output to end of file just as for
+   a shell started for the command: until the command and anything it left
+   running in the background have finished with it.  The shell tells make
+   on a pipe when it has opened the FIFO, and then the command's exit
+   status.
+
+   Only commands that need a shell are run this way; make starts simple
+   commands itself.  The shell must be Bourne-compatible with the default
+   .SHELLFLAGS of "-c", and the command's standard error must be make's own.
+   Commands that use $$, $- or $0 would get the values of the pooled shell,
+   not of a shell of their own, so they are not run this way either.  The
+   messages the shell gives for the command may differ, though: some shells
+   say they come from eval.
+   Otherwise, and whenever a shell cannot be started, the command is run the
+   usual way.  Once a shell has started on a command the command is never
+   run again: if the shell dies, the output there was is the result.  */
+
+#if !defined(WINDOWS32) && !defined(__MSDOS__) && !defined(_AMIGA) \
+    && !defined(VMS)
+# define SHELL_POOL 1
+#endif
+
+unsigned int shell_pool_size = 0;
+
+#ifdef SHELL_POOL
+
+#include <fcntl.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+struct shell_coproc
+  {
+    char *shell;                /* The shell program.  */
+    pid_t pid;                  /* Its process ID.  */
+    int cmd_fd;                 /* Where to write commands to it.  */
+    int status_fd;              /* Where to read their exit status from it.  */
+    int out_fd;                 /* Where to read their output from.  */
+    char *out_name;             /* The FIFO their output is written to.  */
+    unsigned long last_use;     /* When it was last used, for reuse.  */
+  };
+
+static struct shell_coproc *shell_pool = 0;
+static unsigned int shell_pool_count = 0;
+static unsigned long shell_pool_uses = 0;
+
+/* The environment the shells were started with.  */
+static char **shell_pool_environ = 0;
+
+/* Stop the shell in C.  Closing its pipe makes it exit.  Return its wait
+   status, or -1 if it is not known.  */
+
+static int
+shell_coproc_stop (struct shell_coproc *c)
+{
+  pid_t pid;
+  int status;
+
+  close (c->cmd_fd);
+  close (c->status_fd);
+  close (c->out_fd);
+  unlink (c->out_name);
+
+  /* The shell may already have been reaped by reap_children.  */
+  EINTRLOOP (pid, waitpid (c->pid, &status, 0));
+  if (pid != c->pid)
+    status = -1;
+
+  DB (DB_JOBS, (_("Stopped shell %s (pid %ld) for $(shell)\n"),
+                c->shell, (long) c->pid));
+  free (c->shell);
+  free (c->out_name);
+
+  --shell_pool_count;
+  if (c != &shell_pool[shell_pool_count])
+    *c = shell_pool[shell_pool_count];
+
+  return status;
+}
+
+/* Stop all the shells.  */
+
+void
+shell_pool_close (void)
+{
+  while (shell_pool_count > 0)
+    shell_coproc_stop (&shell_pool[0]);
+}
+
+/* Remove the FIFOs of the shells, when make is killed.  */
+
+void
+shell_pool_remove (void)
+{
+  unsigned int i;
+
+  for (i = 0; i < shell_pool_count; ++i)
+    unlink (shell_pool[i].out_name);
+}
+
+/* Make a FIFO for the output of commands, and open it for reading in C.
+   Return nonzero if that worked.  */
+
+static int
+shell_coproc_fifo (struct shell_coproc *c)
+{
+  const char *tmpdir = getenv ("TMPDIR");
+  char *name;
+  int fd;
+
+  if (tmpdir == 0 || *tmpdir == '\0')
+#ifdef P_tmpdir
+    tmpdir = P_tmpdir;
+#else
+    tmpdir = "/tmp";
+#endif
+
+  /* Let mkstemp choose a name, and put the FIFO in the file's place.  If
+     anything else gets there first, don't use it.  */
+  name = xmalloc (strlen (tmpdir) + CSTRLEN ("/GmXXXXXX") + 1);
+  sprintf (name, "%s%sGmXXXXXX", tmpdir,
+           tmpdir[strlen (tmpdir) - 1] == '/' ? "" : "/");
+  fd = mkstemp (name);
+  if (fd < 0)
+    {
+      free (name);
+      return 0;
+    }
+  close (fd);
+  unlink (name);
+  if (mkfifo (name, 0600) < 0)
+    {
+      free (name);
+      return 0;
+    }
+
+  /* Opening a FIFO waits for a writer, unless it is opened not to.  */
+  EINTRLOOP (fd, open (name, O_RDONLY | O_NONBLOCK));
+  if (fd < 0 || fcntl (fd, F_SETFL, 0) < 0)
+    {
+      if (fd >= 0)
+        close (fd);
+      unlink (name);
+      free (name);
+      return 0;
+    }
+  CLOSE_ON_EXEC (fd);
+
+  c->out_fd = fd;
+  c->out_name = name;
+  return 1;
+}
+
+/* Start SHELL reading commands from a pipe, in C.  Return nonzero if it was
+   started.  */
+
+static int
+shell_coproc_start (struct shell_coproc *c, const char *shell)
+{
+  int cmd_pipe[2], status_pipe[2];
+  char *argv[3];
+
+  if (! shell_coproc_fifo (c))
+    return 0;
+  if (pipe (cmd_pipe) < 0)
+    goto fail;
+  if (pipe (status_pipe) < 0)
+    {
+      close (cmd_pipe[0]);
+      close (cmd_pipe[1]);
+      goto fail;
+    }
+
+  /* Keep the ends we use from the shells and from jobs.  */
+  CLOSE_ON_EXEC (cmd_pipe[1]);
+  CLOSE_ON_EXEC (status_pipe[0]);
+
+  argv[0] = (char *) shell;
+  argv[1] = (char *) "-s";
+  argv[2] = 0;
+
+  /* This happens once for each shell, so simply fork.  */
+  c->pid = fork ();
+  if (c->pid == 0)
+    {
+      /* Commands get make's standard input as descriptor 3, and the shell
+         reads them from its own and writes their status to descriptor 4.
+         Move the pipes out of the way first.  */
+      int in = fcntl (cmd_pipe[0], F_DUPFD, 5);
+      int st = fcntl (status_pipe[1], F_DUPFD, 5);
+
+      if (in < 0 || st < 0 || dup2 (FD_STDIN, 3) < 0 || dup2 (st, 4) < 0)
+        _exit (127);
+      if (cmd_pipe[0] > 4)
+        close (cmd_pipe[0]);
+      if (status_pipe[1] > 4)
+        close (status_pipe[1]);
+
+      dup2 (in, FD_STDIN);
+      close (in);
+      close (st);
+      exec_command (argv, environ);
+    }
+
+  close (cmd_pipe[0]);
+  close (status_pipe[1]);
+
+  if (c->pid < 0)
+    {
+      perror_with_name ("fork", "");
+      close (cmd_pipe[1]);
+      close (status_pipe[0]);
+      goto fail;
+    }
+
+  c->shell = xstrdup (shell);
+  c->cmd_fd = cmd_pipe[1];
+  c->status_fd = status_pipe[0];
+  c->last_use = 0;
+
+  DB (DB_JOBS, (_("Started shell %s (pid %ld) for $(shell)\n"),
+                shell, (long) c->pid));
+  return 1;
+
+ fail:
+  close (c->out_fd);
+  unlink (c->out_name);
+  free (c->out_name);
+  return 0;
+}
+
+/* Return a running shell for SHELL, starting one if need be, or null.  */
+
+static struct shell_coproc *
+shell_coproc_get (const char *shell)
+{
+  struct shell_coproc *c;
+  unsigned int i;
+
+  /* If our environment has changed, the shells have the wrong one.  */
+  if (environ != shell_pool_environ)
+    {
+      shell_pool_close ();
+      shell_pool_environ = environ;
+    }
+
+  for (i = 0; i < shell_pool_count; ++i)
+    if (streq (shell_pool[i].shell, shell))
+      return &shell_pool[i];
+
+  if (shell_pool == 0)
+    shell_pool = xmalloc (shell_pool_size * sizeof (struct shell_coproc));
+
+  /* If all are in use, stop the one unused the longest.  */
+  if (shell_pool_count == shell_pool_size)
+    {
+      c = &shell_pool[0];
+      for (i = 1; i < shell_pool_count; ++i)
+        if (shell_pool[i].last_use < c->last_use)
+          c = &shell_pool[i];
+      shell_coproc_stop (c);
+    }
+
+  c = &shell_pool[shell_pool_count];
+  if (! shell_coproc_start (c, shell))
+    return 0;
+
+  ++shell_pool_count;
+  return c;
+}
+
+/* Write LEN bytes of BUF to the shell C.  Return nonzero on success.  */
+
+static int
+shell_coproc_write (struct shell_coproc *c, const char *buf, size_t len)
+{
+  RETSIGTYPE (*pipe_handler) (int);
+  int ok = 1;
+
+  /* If the shell has died we must not be killed writing to it.  */
+  pipe_handler = signal (SIGPIPE, SIG_IGN);
+
+  while (len > 0)
+    {
+      ssize_t n;
+
+      EINTRLOOP (n, write (c->cmd_fd, buf, len));
+      if (n <= 0)
+        {
+          ok = 0;
+          break;
+        }
+      buf += n;
+      len -= n;
+    }
+
+  signal (SIGPIPE, pipe_handler);
+  return ok;
+}
+
+/* Read a line the shell C wrote about the last command into BUF, which has
+   room for SIZE bytes.  Return nonzero if there was one; if not, the shell
+   has gone away.  */
+
+static int
+shell_coproc_line (struct shell_coproc *c, char *buf, unsigned int size)
+{
+  unsigned int i = 0;
+  int cc;
+
+  /* Read a byte at a time: the next line is about the next command.  */
+  while (i < size - 1)
+    {
+      EINTRLOOP (cc, read (c->status_fd, &buf[i], 1));
+      if (cc <= 0)
+        break;
+      if (buf[i++] == '\n')
+        break;
+    }
+  buf[i] = '\0';
+
+  return i > 0 && buf[i - 1] == '\n';
+}
+
+/* Read the output of the command the shell C is running up to end of file,
+   that is until it and anything it started have finished with it, into a
+   new buffer, which the caller must free, in *BUFFERP and its length in
+   *LENP.  */
+
+static void
+shell_coproc_read (struct shell_coproc *c, char **bufferp, unsigned int *lenp)
+{
+  char *buffer;
+  unsigned int maxlen, i;
+  int cc;
+
+  maxlen = 200;
+  buffer = xmalloc (maxlen + 1);
+  i = 0;
+
+  while (1)
+    {
+      if (i == maxlen)
+        {
+          maxlen += 512;
+          buffer = xrealloc (buffer, maxlen + 1);
+        }
+
+      EINTRLOOP (cc, read (c->out_fd, &buffer[i], maxlen - i));
+      if (cc <= 0)
+        break;
+      i += cc;
+    }
+
+  buffer[i] = '\0';
+  *bufferp = buffer;
+  *lenp = i;
+}
+
+/* Append S to SCRIPT quoted for the shell, and return the end.  */
+
+static char *
+shell_coproc_quote (char *script, const char *s)
+{
+  *(script++) = '\'';
+  for (; *s != '\0'; ++s)
+    if (*s == '\'')
+      {
+        memcpy (script, "'\\''", 4);
+        script += 4;
+      }
+    else
+      *(script++) = *s;
+  *(script++) = '\'';
+
+  return script;
+}
+
+/* Return nonzero if COMMAND uses $$, $- or $0, as $X or ${X}.  */
+
+static int
+shell_pool_shell_params (const char *command)
+{
+  const char *p;
+
+  for (p = strchr (command, '$'); p != 0; p = strchr (p + 1, '$'))
+    {
+      const char *q = p[1] == '{' ? p + 2 : p + 1;
+
+      if (*q == '$' || *q == '-' || *q == '0')
+        return 1;
+    }
+
+  return 0;
+}
+
+/* Run the command in ARGV with a shell from the pool, if it can be run that
+   way: if ARGV runs a Bourne-compatible shell with "-c" and a command.  If
+   so, return nonzero with its exit status and the number of the signal that
+   killed it, if any, in *STATUSP and *SIGP, and its output, which the caller
+   must free, in *BUFFERP and *LENP.  */
+
+int
+shell_pool_run (char **argv, int *statusp, int *sigp, char **bufferp,
+                unsigned int *lenp)
+{
+  struct shell_coproc *c;
+  const char *command;
+  char *script, *s;
+  char line[32];
+  int status;
+
+  if (shell_pool_size == 0)
+    return 0;
+
+  /* Make starts commands that need no shell itself.  */
+  if (argv[1] == 0 || strcmp (argv[1], "-c") != 0
+      || argv[2] == 0 || argv[3] != 0
+      || ! is_bourne_compatible_shell (argv[0])
+      || shell_pool_shell_params (argv[2]))
+    return 0;
+  command = argv[2];
+
+  c = shell_coproc_get (argv[0]);
+  if (c == 0)
+    return 0;
+
+  c->last_use = ++shell_pool_uses;
+
+  /* The shell opens the FIFO, says it has, runs the command with its output
+     going there and says how it exited.  */
+  script = xmalloc (4 * (strlen (command) + strlen (c->out_name)) + 128);
+  s = script;
+  strcpy (s, "exec 5>");
+  s = shell_coproc_quote (s + CSTRLEN ("exec 5>"), c->out_name);
+  strcpy (s, "; echo >&4; (eval ");
+  s = shell_coproc_quote (s + CSTRLEN ("; echo >&4; (eval "), command);
+  strcpy (s, ") <&3 3<&- 4>&- >&5 5>&-; echo \"$?\" >&4; exec 5>&-\n");
+
+  /* Until the shell says it has the FIFO open, nothing has been run, and the
+     command can still be run the usual way.  */
+  if (! shell_coproc_write (c, script, strlen (script))
+      || ! shell_coproc_line (c, line, sizeof (line)))
+    {
+      free (script);
+      DB (DB_JOBS, (_("Lost shell %s (pid %ld) for $(shell)\n"),
+                    c->shell, (long) c->pid));
+      shell_coproc_stop (c);
+      return 0;
+    }
+  free (script);
+
+  shell_coproc_read (c, bufferp, lenp);
+
+  *sigp = 0;
+  if (shell_coproc_line (c, line, sizeof (line)) && ISDIGIT (line[0]))
+    {
+      *statusp = atoi (line);
+      return 1;
+    }
+
+  /* The shell died while the command ran.  It must not be run again, so
+     give what output there was, with the status of the shell.  */
+  DB (DB_JOBS, (_("Lost shell %s (pid %ld) for $(shell)\n"),
+                c->shell, (long) c->pid));
+  status = shell_coproc_stop (c);
+  if (status == -1)
+    *statusp = 1;
+  else if (WIFSIGNALED (status))
+    {
+      *statusp = 0;
+      *sigp = WTERMSIG (status);
+    }
+  else
+    *statusp = WEXITSTATUS (status);
+
+  return 1;
+}
+
+#else /* !SHELL_POOL */
+
+int
+shell_pool_run (char **argv UNUSED, int *statusp UNUSED, int *sigp UNUSED,
+                char **bufferp UNUSED, unsigned int *lenp UNUSED)
+{
+  return 0;
+}
+
+void
+shell_pool_close (void)
+{
+}
+
+void
+shell_pool_remove (void)
+{
+}
+
+#endif /* !SHELL_POOL */
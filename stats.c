@@ -0,0 +1,194 @@
+/* Timers and counters for GNU Make.
+Copyright (C) 2015 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+#include "filedef.h"
+#include "dep.h"
+#include "variable.h"
+#include "hash.h"
+
+#include <time.h>
+
+/* With --stats, make times some of the things it spends its time on, and
+   prints a report when it exits.  Counters are always kept, since they cost
+   next to nothing; the clocks are only read with --stats.
+
+   Each timer measures both elapsed (wall) and processor time.  A timer that
+   is started again while it is running, as when a makefile is included by
+   another or an expansion expands another, just counts the outermost use.
+   Timers do overlap each other: the time spent reading makefiles includes
+   the expansions done while reading them, for instance.  */
+
+unsigned long stats_counts[STATS_COUNTS];
+
+struct stats_timer_data
+  {
+    unsigned int depth;         /* Number of nested uses running.  */
+    unsigned long uses;         /* Number of outermost uses.  */
+    double wall;                /* Total elapsed time.  */
+    double cpu;                 /* Total processor time.  */
+    double start_wall;          /* Times at the start of the current use.  */
+    double start_cpu;
+  };
+
+static struct stats_timer_data stats_timers[STATS_TIMERS];
+
+static const char *const stats_timer_names[STATS_TIMERS] =
+  {
+    N_("reading makefiles"),
+    N_("expanding"),
+    N_("implicit rule search"),
+    N_("file status"),
+    N_("reading directories"),
+    N_("starting jobs"),
+    N_("output-sync waits")
+  };
+
+static const char *const stats_count_names[STATS_COUNTS] =
+  {
+    N_("makefiles read"),
+    N_("makefiles mapped"),
+    N_("dependency makefiles"),
+    N_("variable expansions"),
+    N_("expansions compiled"),
+    N_("expansions memoized"),
+    N_("$(shell) calls"),
+    N_("implicit rule searches"),
+    N_("stat calls"),
+    N_("directories read"),
+    N_("directory entries"),
+    N_("jobs started"),
+    N_("dep lists compacted")
+  };
+
+/* Return the elapsed time in seconds since some fixed time.  */
+
+static double
+stats_wall_clock (void)
+{
+#if HAVE_CLOCK_GETTIME && defined CLOCK_MONOTONIC
+  struct timespec ts;
+  if (clock_gettime (CLOCK_MONOTONIC, &ts) == 0)
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+#if HAVE_GETTIMEOFDAY
+  {
+    struct timeval tv;
+    if (gettimeofday (&tv, 0) == 0)
+      return tv.tv_sec + tv.tv_usec / 1e6;
+  }
+#endif
+  return (double) time (0);
+}
+
+/* Return the processor time used so far, in seconds.  */
+
+static double
+stats_cpu_clock (void)
+{
+  return (double) clock () / CLOCKS_PER_SEC;
+}
+
+/* The time at which make started, for the totals.  */
+
+static double stats_start_wall;
+
+void
+stats_init (void)
+{
+  stats_start_wall = stats_wall_clock ();
+}
+
+void
+stats_start (enum stats_timer timer)
+{
+  struct stats_timer_data *t = &stats_timers[timer];
+
+  if (t->depth++ > 0)
+    return;
+
+  t->start_wall = stats_wall_clock ();
+  t->start_cpu = stats_cpu_clock ();
+}
+
+void
+stats_stop (enum stats_timer timer)
+{
+  struct stats_timer_data *t = &stats_timers[timer];
+
+  if (t->depth == 0 || --t->depth > 0)
+    return;
+
+  t->wall += stats_wall_clock () - t->start_wall;
+  t->cpu += stats_cpu_clock () - t->start_cpu;
+  ++t->uses;
+}
+
+/* Print a line about the hash table HT, called NAME.  */
+
+void
+stats_print_hash (const char *name, struct hash_table *ht)
+{
+  printf (_("  %-24s %8lu lookups, %.2f probes each, load %lu/%lu\n"),
+          name, ht->ht_lookups,
+          (ht->ht_lookups
+           ? (double) (ht->ht_lookups + ht->ht_probes) / ht->ht_lookups : 0),
+          ht->ht_fill, ht->ht_size);
+}
+
+/* Print a line about arena A.  */
+
+void
+stats_print_arena (const struct arena *a)
+{
+  printf (_("  %-24s %8lu in use, %lu at most, %lu KB in %lu blocks\n"),
+          a->name, a->live, a->peak, a->bytes / 1024, a->blocks);
+}
+
+/* Print the report.  */
+
+void
+stats_print (void)
+{
+  unsigned int i;
+
+  printf (_("\n%s: statistics for this run:\n"), program);
+
+  printf (_("  %-24s %10s %10s %10s\n"), _("Timer"), _("uses"),
+          _("wall (s)"), _("cpu (s)"));
+  for (i = 0; i < STATS_TIMERS; ++i)
+    printf ("  %-24s %10lu %10.3f %10.3f\n", _(stats_timer_names[i]),
+            stats_timers[i].uses, stats_timers[i].wall, stats_timers[i].cpu);
+  printf ("  %-24s %10s %10.3f %10.3f\n", _("total"), "",
+          stats_wall_clock () - stats_start_wall, stats_cpu_clock ());
+
+  putc ('\n', stdout);
+  for (i = 0; i < STATS_COUNTS; ++i)
+    printf ("  %-24s %10lu\n", _(stats_count_names[i]), stats_counts[i]);
+
+  putc ('\n', stdout);
+  stats_print_arena (&file_arena);
+  stats_print_arena (&dep_arena);
+  strcache_print_memory_stats ();
+
+  putc ('\n', stdout);
+  print_file_stats ();
+  print_variable_stats ();
+  print_dir_stats ();
+  strcache_print_hash_stats ();
+
+  fflush (stdout);
+}
@@ -23,26 +23,44 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 /* A string cached here will never be freed, so we don't need to worry about
    reference counting.  We just store the string, and then remember it in a
-   hash so it can be looked up again. */
+   hash so it can be looked up again.
 
-typedef unsigned short int sc_buflen_t;
+   Before each string its hash and length are stored, so that they need not
+   be computed again: not only by the hash table here, but by any other
+   table of cached strings, through strcache_hash().  */
+
+typedef unsigned int sc_buflen_t;
 
 struct strcache {
   struct strcache *next;    /* The next block of strings.  Must be first!  */
+  sc_buflen_t size;         /* Size of this buffer.  */
   sc_buflen_t end;          /* Offset to the beginning of free space.  */
   sc_buflen_t bytesfree;    /* Free space left in this buffer.  */
   sc_buflen_t count;        /* # of strings in this buffer (for stats).  */
   char buffer[1];           /* The buffer comes after this.  */
 };
 
-/* The size (in bytes) of each cache buffer.
-   Try to pick something that will map well into the heap.
-   This must be able to be represented by a short int (<=65535).  */
+/* The size (in bytes) of the cache buffers.  The first is
+   CACHE_BUFFER_BASE bytes and each one after is twice as big as the last,
+   up to CACHE_BUFFER_MAX, so that small makefiles need little memory and
+   large ones few allocations.  The sizes are picked to map well into the
+   heap: the largest are a whole number of pages, or one huge page.
+   Strings larger than CACHE_LARGE_STRING get a buffer of their own.  */
 #define CACHE_BUFFER_BASE       (8192)
+#define CACHE_BUFFER_MAX        (1024 * 1024)
+#define CACHE_LARGE_STRING      (CACHE_BUFFER_MAX / 16)
 #define CACHE_BUFFER_ALLOC(_s)  ((_s) - (2 * sizeof (size_t)))
 #define CACHE_BUFFER_OFFSET     (offsetof (struct strcache, buffer))
 #define CACHE_BUFFER_SIZE(_s)   (CACHE_BUFFER_ALLOC(_s) - CACHE_BUFFER_OFFSET)
-#define BUFSIZE                 CACHE_BUFFER_SIZE (CACHE_BUFFER_BASE)
+
+/* The size to allocate the next cache buffer.  */
+static unsigned int buffer_alloc = CACHE_BUFFER_BASE;
+
+/* The header stored before each string.  Strings are packed one after
+   another, so it is read and written with memcpy.  */
+#define SC_HASH_OFFSET  (2 * sizeof (unsigned int))
+#define SC_LEN_OFFSET   (sizeof (unsigned int))
+#define SC_HEADER_SIZE  SC_HASH_OFFSET
 
 static struct strcache *strcache = NULL;
 static struct strcache *fullcache = NULL;
@@ -50,6 +68,8 @@ static struct strcache *fullcache = NULL;
 static unsigned long total_buffers = 0;
 static unsigned long total_strings = 0;
 static unsigned long total_size = 0;
+static unsigned long total_alloc = 0;
+static unsigned long total_large = 0;
 
 /* Add a new buffer to the cache.  Add it at the front to reduce search time.
    This can also increase the overhead, since it's less likely that older
@@ -60,6 +80,7 @@ static struct strcache *
 new_cache (struct strcache **head, sc_buflen_t buflen)
 {
   struct strcache *new = xmalloc (buflen + CACHE_BUFFER_OFFSET);
+  new->size = buflen;
   new->end = 0;
   new->count = 0;
   new->bytesfree = buflen;
@@ -68,42 +89,47 @@ new_cache (struct strcache **head, sc_buflen_t buflen)
   *head = new;
 
   ++total_buffers;
+  total_alloc += buflen + CACHE_BUFFER_OFFSET;
   return new;
 }
 
 static const char *
-copy_string (struct strcache *sp, const char *str, unsigned int len)
+copy_string (struct strcache *sp, const char *str, unsigned int len,
+             unsigned int hash)
 {
   /* Add the string to this cache.  */
-  char *res = &sp->buffer[sp->end];
+  char *res = &sp->buffer[sp->end] + SC_HEADER_SIZE;
 
+  memcpy (res - SC_HASH_OFFSET, &hash, sizeof (hash));
+  memcpy (res - SC_LEN_OFFSET, &len, sizeof (len));
   memmove (res, str, len);
   res[len++] = '\0';
-  sp->end += len;
-  sp->bytesfree -= len;
+  sp->end += len + SC_HEADER_SIZE;
+  sp->bytesfree -= len + SC_HEADER_SIZE;
   ++sp->count;
 
   return res;
 }
 
 static const char *
-add_string (const char *str, unsigned int len)
+add_string (const char *str, unsigned int len, unsigned int hash)
 {
   const char *res;
   struct strcache *sp;
   struct strcache **spp = &strcache;
-  /* We need space for the nul char.  */
-  unsigned int sz = len + 1;
+  /* We need space for the header and the nul char.  */
+  unsigned int sz = len + 1 + SC_HEADER_SIZE;
 
   ++total_strings;
   total_size += sz;
 
-  /* If the string we want is too large to fit into a single buffer, then
-     no existing cache is large enough.  Add it directly to the fullcache.  */
-  if (sz > BUFSIZE)
+  /* A large string gets a buffer of its own, directly on the fullcache:
+     it would only leave a large part of a shared one unused.  */
+  if (sz > CACHE_LARGE_STRING)
     {
+      ++total_large;
       sp = new_cache (&fullcache, sz);
-      return copy_string (sp, str, len);
+      return copy_string (sp, str, len, hash);
     }
 
   /* Find the first cache with enough free space.  */
@@ -115,12 +141,16 @@ add_string (const char *str, unsigned int len)
   sp = *spp;
   if (sp == NULL)
     {
-      sp = new_cache (&strcache, BUFSIZE);
+      while (CACHE_BUFFER_SIZE (buffer_alloc) < sz)
+        buffer_alloc *= 2;
+      sp = new_cache (&strcache, CACHE_BUFFER_SIZE (buffer_alloc));
       spp = &sp;
+      if (buffer_alloc < CACHE_BUFFER_MAX)
+        buffer_alloc *= 2;
     }
 
   /* Add the string to this cache.  */
-  res = copy_string (sp, str, len);
+  res = copy_string (sp, str, len, hash);
 
   /* If the amount free in this cache is less than the average string size,
      consider it full and move it to the full list.  */
@@ -135,12 +165,41 @@ add_string (const char *str, unsigned int len)
 }
 
 
-/* Hash table of strings in the cache.  */
+/* Return the hash of the cached string STR.  It is the value of
+   ISTRING_HASH_1, truncated to an unsigned int.  */
+
+unsigned long
+strcache_hash (const char *str)
+{
+  unsigned int hash;
+  memcpy (&hash, str - SC_HASH_OFFSET, sizeof (hash));
+  return hash;
+}
+
+/* Return the length of the cached string STR.  */
+
+unsigned int
+strcache_len (const char *str)
+{
+  unsigned int len;
+  memcpy (&len, str - SC_LEN_OFFSET, sizeof (len));
+  return len;
+}
+
+/* Hash table of strings in the cache.  Everything in it is a cached string,
+   except the string add_hash is looking up, whose hash and length it
+   computes first.  */
+
+static const char *lookup_key = 0;
+static unsigned int lookup_key_hash;
+static unsigned int lookup_key_len;
 
 static unsigned long
 str_hash_1 (const void *key)
 {
-  return_ISTRING_HASH_1 ((const char *) key);
+  if (key == lookup_key)
+    return lookup_key_hash;
+  return strcache_hash (key);
 }
 
 static unsigned long
@@ -152,6 +211,9 @@ str_hash_2 (const void *key)
 static int
 str_hash_cmp (const void *x, const void *y)
 {
+  /* Strings of different lengths can't be the same.  */
+  if (x == lookup_key && strcache_len (y) != lookup_key_len)
+    return 1;
   return_ISTRING_COMPARE ((const char *) x, (const char *) y);
 }
 
@@ -161,9 +223,19 @@ static unsigned long total_adds = 0;
 static const char *
 add_hash (const char *str, int len)
 {
+  char *const *slot;
+  const char *key;
+  unsigned long hash = 0;
+
+  ISTRING_HASH_1 (str, hash);
+  lookup_key = str;
+  lookup_key_hash = hash;
+  lookup_key_len = len;
+
   /* Look up the string in the hash.  If it's there, return it.  */
-  char *const *slot = (char *const *) hash_find_slot (&strings, str);
-  const char *key = *slot;
+  slot = (char *const *) hash_find_slot (&strings, str);
+  key = *slot;
+  lookup_key = 0;
 
   /* Count the total number of add operations we performed.  */
   ++total_adds;
@@ -172,7 +244,7 @@ add_hash (const char *str, int len)
     return key;
 
   /* Not there yet so add it to a buffer, then into the hash table.  */
-  key = add_string (str, len);
+  key = add_string (str, len, lookup_key_hash);
   hash_insert_at (&strings, key, slot);
   return key;
 }
@@ -232,7 +304,7 @@ strcache_print_stats (const char *prefix)
 {
   const struct strcache *sp;
   unsigned long numbuffs = 0, fullbuffs = 0;
-  unsigned long totfree = 0, maxfree = 0, minfree = BUFSIZE;
+  unsigned long totfree = 0, maxfree = 0, minfree = CACHE_BUFFER_MAX;
 
   if (! strcache)
     {
@@ -270,9 +342,12 @@ strcache_print_stats (const char *prefix)
           prefix, numbuffs + 1, fullbuffs, total_strings, total_size,
           (total_size / total_strings));
 
-  printf (_("%s current buf: size = %hu B / used = %hu B / count = %hu / avg = %hu B\n"),
-          prefix, (sc_buflen_t)BUFSIZE, strcache->end, strcache->count,
-          (strcache->end / strcache->count));
+  printf (_("%s large strings: %lu / allocated = %lu B / unused = %lu B\n"),
+          prefix, total_large, total_alloc, total_alloc - total_size);
+
+  printf (_("%s current buf: size = %u B / used = %u B / count = %u / avg = %u B\n"),
+          prefix, strcache->size, strcache->end, strcache->count,
+          strcache->count ? strcache->end / strcache->count : 0);
 
   if (numbuffs)
     {
@@ -284,7 +359,7 @@ strcache_print_stats (const char *prefix)
       printf (_("%s other used: total = %lu B / count = %lu / avg = %lu B\n"),
               prefix, sz, cnt, sz / cnt);
 
-      printf (_("%s other free: total = %lu B / max = %lu B / min = %lu B / avg = %hu B\n"),
+      printf (_("%s other free: total = %lu B / max = %lu B / min = %lu B / avg = %u B\n"),
               prefix, totfree, maxfree, minfree, avgfree);
     }
 
@@ -293,3 +368,21 @@ strcache_print_stats (const char *prefix)
   fputs (_("# hash-table stats:\n# "), stdout);
   hash_print_stats (&strings, stdout);
 }
+
+/* Print the memory the strcache uses for --stats.  */
+
+void
+strcache_print_memory_stats (void)
+{
+  printf (_("  %-24s %8lu in use, %lu large, %lu KB in %lu blocks, %lu KB unused\n"),
+          _("strings"), total_strings, total_large, total_alloc / 1024,
+          total_buffers, (total_alloc - total_size) / 1024);
+}
+
+/* Print the hash table statistics for --stats.  */
+
+void
+strcache_print_hash_stats (void)
+{
+  stats_print_hash (_("strings"), &strings);
+}
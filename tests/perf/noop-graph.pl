@@ -0,0 +1,94 @@
+#!/usr/bin/perl
+#                                                                    -*-perl-*-
+#
+# Time a no-op build of a large synthetic graph of up-to-date files.
+#
+# usage: perl noop-graph.pl [-make PATH] [-dir DIR] [-files N] [-fanin N]
+#                           [-goals N] [-runs N] [-seed N]
+#
+# DIR (default "noop-graph") is filled with FILES files, each depending on
+# FANIN random earlier ones, and a makefile whose goal depends on the last
+# GOALS of them.  Each file is given a newer time than any file it depends
+# on, so there is nothing to do.  Make is then run RUNS times with --stats,
+# and the processor time it spent after reading the makefile, which is
+# where it walks the graph and checks file times, is reported for each run,
+# along with the median and the best.
+#
+# The defaults are the graph quoted when the members of struct file were
+# reordered: 200000 files, 8 prerequisites each, 1000 goals, 9 runs.
+#
+# This is not part of the test suite; run it by hand, and compare two
+# builds of make on the same DIR.
+
+use strict;
+
+my %opt = (make => 'make', dir => 'noop-graph', files => 200000,
+           fanin => 8, goals => 1000, runs => 9, seed => 1);
+
+while (@ARGV) {
+  my $arg = shift @ARGV;
+  $arg =~ /^-(\w+)$/ && exists $opt{$1} && @ARGV
+    or die "usage: $0 [-make PATH] [-dir DIR] [-files N] [-fanin N]"
+           . " [-goals N] [-runs N] [-seed N]\n";
+  $opt{$1} = shift @ARGV;
+}
+
+my $dir = $opt{dir};
+my $n = $opt{files};
+
+# Generate the graph, unless DIR already has it.
+
+if (! -f "$dir/Makefile") {
+  -d $dir or mkdir ($dir, 0777) or die "$dir: $!\n";
+  srand ($opt{seed});
+
+  open (MF, "> $dir/Makefile.tmp") or die "$dir/Makefile.tmp: $!\n";
+  print MF "all:";
+  for (my $i = ($n > $opt{goals} ? $n - $opt{goals} : 0); $i < $n; ++$i) {
+    print MF " f$i";
+  }
+  print MF "\n\t\@:\n";
+
+  my $now = time;
+  for (my $i = 0; $i < $n; ++$i) {
+    print MF "f$i:";
+    if ($i > 0) {
+      for (my $j = 0; $j < $opt{fanin}; ++$j) {
+        print MF " f", int (rand ($i));
+      }
+    }
+    print MF "\n";
+
+    open (F, "> $dir/f$i") or die "$dir/f$i: $!\n";
+    close (F);
+    my $t = $now - $n + $i;
+    utime ($t, $t, "$dir/f$i");
+  }
+  close (MF);
+  rename ("$dir/Makefile.tmp", "$dir/Makefile") or die "$dir/Makefile: $!\n";
+}
+
+# Time the runs.
+
+my @times;
+for (my $r = 0; $r < $opt{runs}; ++$r) {
+  my ($total, $reading);
+
+  open (MK, "cd $dir && $opt{make} -r --stats 2>&1 |")
+    or die "$opt{make}: $!\n";
+  while (<MK>) {
+    $reading = $1 if /^\s*reading makefiles\s+\d+\s+\S+\s+(\S+)/;
+    $total = $1 if /^\s*total\s+\S+\s+(\S+)/;
+  }
+  close (MK) or die "$opt{make} failed\n";
+  defined $total && defined $reading
+    or die "$opt{make} did not print --stats timers\n";
+
+  push @times, $total - $reading;
+  printf "run %d: %.3fs\n", $r + 1, $total - $reading;
+}
+
+@times = sort { $a <=> $b } @times;
+printf "median %.3fs, best %.3fs\n", $times[$#times / 2], $times[0];
+
+1;
@@ -0,0 +1,245 @@
+/* Trace events of a build for GNU Make.
+Copyright (C) 2015 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+
+#if HAVE_CLOCK_GETTIME
+# include <time.h>
+#endif
+
+/* With --trace-events=FILE, make writes the times at which it starts and
+   finishes its phases (reading makefiles, remaking them, searching for
+   implicit rules...) and the jobs it runs to FILE, in the JSON trace event
+   format read by chrome://tracing and Perfetto.  Make's own work is shown as
+   thread 0; each job is shown on the thread of the job slot it ran in, so
+   the trace shows how busy the slots were.
+
+   Each event is written as soon as it happens.  If make is interrupted the
+   array is left unterminated, which the viewers accept.  */
+
+static FILE *trace_fp = 0;
+static const char *trace_name;
+
+/* Nonzero until the first event has been written.  */
+static int trace_first = 1;
+
+/* Process ID shown for all events.  */
+static unsigned long trace_pid;
+
+/* The state of each job slot there has been: 0 if never used, 1 if in use,
+   2 if free again.  */
+static char *trace_slots = 0;
+static unsigned int trace_nslots = 0;
+
+/* Write the time now, in microseconds.  A monotonic clock is used where
+   there is one, so that it carries on across re-executions of make.  */
+
+static void
+trace_time (void)
+{
+  unsigned long s, us;
+
+#if HAVE_CLOCK_GETTIME && defined CLOCK_MONOTONIC
+  struct timespec ts;
+  if (clock_gettime (CLOCK_MONOTONIC, &ts) == 0)
+    {
+      s = ts.tv_sec;
+      us = ts.tv_nsec / 1000;
+      goto got_time;
+    }
+#endif
+#if HAVE_GETTIMEOFDAY
+  {
+    struct timeval tv;
+    if (gettimeofday (&tv, 0) == 0)
+      {
+        s = tv.tv_sec;
+        us = tv.tv_usec;
+        goto got_time;
+      }
+  }
+#endif
+
+  s = time (0);
+  us = 0;
+
+#if (HAVE_CLOCK_GETTIME && defined CLOCK_MONOTONIC) || HAVE_GETTIMEOFDAY
+ got_time:
+#endif
+  if (s)
+    fprintf (trace_fp, ",\"ts\":%lu%06lu", s, us);
+  else
+    fprintf (trace_fp, ",\"ts\":%lu", us);
+}
+
+/* Write S as the contents of a JSON string.  */
+
+static void
+trace_string (const char *s)
+{
+  for (; *s != '\0'; ++s)
+    {
+      unsigned char c = *s;
+
+      if (c == '"' || c == '\\')
+        {
+          putc ('\\', trace_fp);
+          putc (c, trace_fp);
+        }
+      else if (c < 0x20)
+        fprintf (trace_fp, "\\u%04x", c);
+      else
+        putc (c, trace_fp);
+    }
+}
+
+/* Start a new event of type PH on thread TID.  */
+
+static void
+trace_event (char ph, unsigned int tid)
+{
+  fputs (trace_first ? "\n" : ",\n", trace_fp);
+  trace_first = 0;
+
+  fprintf (trace_fp, "{\"ph\":\"%c\",\"pid\":%lu,\"tid\":%u", ph, trace_pid,
+           tid);
+  if (ph != 'M')
+    trace_time ();
+}
+
+/* Name thread TID as NAME, with NUM appended if it is nonzero.  */
+
+static void
+trace_thread_name (unsigned int tid, const char *name, unsigned int num)
+{
+  trace_event ('M', tid);
+  fputs (",\"name\":\"thread_name\",\"args\":{\"name\":\"", trace_fp);
+  trace_string (name);
+  if (num)
+    fprintf (trace_fp, " %u", num);
+  fputs ("\"}}", trace_fp);
+}
+
+/* Start writing events to FILE.  If APPEND is nonzero, this make has been
+   re-executed and adds to the events written by the last one.  */
+
+void
+trace_events_open (const char *file, int append)
+{
+  long pos;
+
+  ENULLLOOP (trace_fp, fopen (file, append ? "a" : "w"));
+  if (trace_fp == 0)
+    {
+      perror_with_name ("", file);
+      return;
+    }
+
+  trace_name = file;
+  trace_pid = (unsigned long) getpid ();
+
+  fseek (trace_fp, 0, SEEK_END);
+  pos = ftell (trace_fp);
+  if (pos > 0)
+    trace_first = 0;
+  else
+    {
+      putc ('[', trace_fp);
+      trace_thread_name (0, program, 0);
+    }
+}
+
+/* Stop writing events.  If LAST is nonzero, end the array; otherwise the
+   events are left to a re-executed make to finish.  */
+
+void
+trace_events_close (int last)
+{
+  if (trace_fp == 0)
+    return;
+
+  if (last)
+    fputs ("\n]\n", trace_fp);
+  if (fclose (trace_fp) != 0)
+    perror_with_name ("", trace_name);
+  trace_fp = 0;
+}
+
+/* Note that a phase of category CAT, called NAME, starts on thread TID.  */
+
+void
+trace_begin (const char *cat, const char *name, unsigned int tid)
+{
+  if (trace_fp == 0)
+    return;
+
+  trace_event ('B', tid);
+  fputs (",\"cat\":\"", trace_fp);
+  trace_string (cat);
+  fputs ("\",\"name\":\"", trace_fp);
+  trace_string (name);
+  fputs ("\"}", trace_fp);
+}
+
+/* Note that the last phase started on thread TID has ended.  */
+
+void
+trace_end (unsigned int tid)
+{
+  if (trace_fp == 0)
+    return;
+
+  trace_event ('E', tid);
+  putc ('}', trace_fp);
+}
+
+/* Return the thread of a free job slot, and mark it in use.  */
+
+unsigned int
+trace_slot_get (void)
+{
+  unsigned int i;
+
+  if (trace_fp == 0)
+    return 0;
+
+  for (i = 0; i < trace_nslots; ++i)
+    if (trace_slots[i] != 1)
+      break;
+
+  if (i == trace_nslots)
+    {
+      trace_nslots = trace_nslots ? trace_nslots * 2 : 16;
+      trace_slots = xrealloc (trace_slots, trace_nslots);
+      memset (trace_slots + i, 0, trace_nslots - i);
+    }
+
+  /* The first time a slot is used, give its thread a name.  */
+  if (trace_slots[i] == 0)
+    trace_thread_name (i + 1, _("job slot"), i + 1);
+
+  trace_slots[i] = 1;
+  return i + 1;
+}
+
+/* Mark the job slot of thread TID free.  */
+
+void
+trace_slot_put (unsigned int tid)
+{
+  if (tid > 0 && tid <= trace_nslots)
+    trace_slots[tid - 1] = 2;
+}
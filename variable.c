@@ -82,6 +82,8 @@ create_pattern_var (const char *target, const char *suffix)
   p->target = target;
   p->len = len;
   p->suffix = suffix + 1;
+  p->variable.compiled = 0;
+  p->variable.global = 0;
 
   if (len < 256)
     last_pattern_vars[len] = p;
@@ -169,6 +171,12 @@ static struct variable_set global_variable_set;
 static struct variable_set_list global_setlist
   = { 0, &global_variable_set, 0 };
 struct variable_set_list *current_variable_set_list = &global_setlist;
+
+/* Counts the changes to the global variable set: each variable defined,
+   redefined or undefined there.  Expansions memoized before a change are not
+   used after it.  */
+
+unsigned long global_variable_changes = 0;
 
 /* Implement variables.  */
 
@@ -220,6 +228,9 @@ define_variable_in_set (const char *name, unsigned int length,
          than this one, don't redefine it.  */
       if ((int) origin >= (int) v->origin)
         {
+          if (set == &global_variable_set)
+            ++global_variable_changes;
+          forget_compiled_value (v);
           free (v->value);
           v->value = xstrdup (value);
           if (flocp != 0)
@@ -238,7 +249,11 @@ define_variable_in_set (const char *name, unsigned int length,
   v->name = xstrndup (name, length);
   v->length = length;
   hash_insert_at (&set->table, v, var_slot);
+  v->global = set == &global_variable_set;
+  if (v->global)
+    ++global_variable_changes;
   v->value = xstrdup (value);
+  v->compiled = 0;
   if (flocp != 0)
     v->fileinfo = *flocp;
   else
@@ -280,6 +295,7 @@ static void
 free_variable_name_and_value (const void *item)
 {
   struct variable *v = (struct variable *) item;
+  forget_compiled_value (v);
   free (v->name);
   free (v->value);
 }
@@ -324,6 +340,8 @@ undefine_variable_in_set (const char *name, unsigned int length,
          undefine it.  */
       if ((int) origin >= (int) v->origin)
         {
+          if (set == &global_variable_set)
+            ++global_variable_changes;
           hash_delete_at (&set->table, var_slot);
           free_variable_name_and_value (v);
         }
@@ -381,6 +399,8 @@ lookup_special_var (struct variable *var)
       struct variable **end = &vp[global_variable_set.table.ht_size];
 
       /* Make sure we have at least MAX bytes in the allocated buffer.  */
+      ++global_variable_changes;
+      forget_compiled_value (var);
       var->value = xrealloc (var->value, max);
 
       /* Walk through the hash of variables, constructing a list of names.  */
@@ -679,6 +699,7 @@ merge_variable_sets (struct variable_set *to_set,
         else
           {
             /* GKM FIXME: delete in from_set->table */
+            forget_compiled_value (from_var);
             free (from_var->value);
             free (from_var);
           }
@@ -755,6 +776,8 @@ define_automatic_variables (void)
   /* Don't let SHELL come from the environment.  */
   if (*v->value == '\0' || v->origin == o_env || v->origin == o_env_override)
     {
+      ++global_variable_changes;
+      forget_compiled_value (v);
       free (v->value);
       v->origin = o_file;
       v->value = xstrdup (default_shell);
@@ -1431,6 +1454,14 @@ print_variable_data_base (void)
   }
 }
 
+/* Print the hash table statistics for --stats.  */
+
+void
+print_variable_stats (void)
+{
+  stats_print_hash (_("global variables"), &global_variable_set.table);
+}
+
 
 /* Print all the local variables of FILE.  */
 
@@ -51,6 +51,8 @@ struct variable
   {
     char *name;                 /* Variable name.  */
     char *value;                /* Variable value.  */
+    struct compiled_expansion *compiled;
+                                /* The value compiled for expansion.  */
     gmk_floc fileinfo;          /* Where the variable was defined.  */
     int length;                 /* strlen (name) */
     unsigned int recursive:1;   /* Gets recursively re-evaluated.  */
@@ -64,6 +66,7 @@ struct variable
     unsigned int expanding:1;   /* Nonzero if currently being expanded.  */
     unsigned int private_var:1; /* Nonzero avoids inheritance of this
                                    target-specific variable.  */
+    unsigned int global:1;      /* Nonzero if in the global variable set.  */
     unsigned int exp_count:EXP_COUNT_BITS;
                                 /* If >1, allow this many self-referential
                                    expansions.  */
@@ -110,6 +113,7 @@ struct pattern_var
 extern char *variable_buffer;
 extern struct variable_set_list *current_variable_set_list;
 extern struct variable *default_goal_var;
+extern unsigned long global_variable_changes;
 
 /* expand.c */
 char *variable_buffer_output (char *ptr, const char *string, unsigned int length);
@@ -122,9 +126,22 @@ char *expand_argument (const char *str, const char *end);
 char *variable_expand_string (char *line, const char *string, long length);
 void install_variable_buffer (char **bufp, unsigned int *lenp);
 void restore_variable_buffer (char *buf, unsigned int len);
+void forget_compiled_value (struct variable *v);
+void expansion_not_pure (void);
+char *allocated_compiled_expand_for_file (struct compiled_expansion **cp,
+                                          const char *line,
+                                          struct file *file);
 
 /* function.c */
+struct function_table_entry;
+extern unsigned int functions_defined;
 int handle_function (char **op, const char **stringp);
+const struct function_table_entry *split_function (const char **stringp,
+                                                   int *expandp,
+                                                   const char ***argsp,
+                                                   int *nargsp);
+char *expand_builtin_function (char *o, int argc, char **argv,
+                               const struct function_table_entry *entry_p);
 int pattern_matches (const char *pattern, const char *percent, const char *str);
 char *subst_expand (char *o, const char *text, const char *subst,
                     const char *replace, unsigned int slen, unsigned int rlen,
@@ -150,6 +167,7 @@ void initialize_file_variables (struct file *file, int reading);
 void print_file_variables (const struct file *file);
 void print_file_variables (const struct file *file);
 void print_target_variables (const struct file *file);
+void print_variable_stats (void);
 void merge_variable_set_lists (struct variable_set_list **to_list,
                                struct variable_set_list *from_list);
 struct variable *do_variable_definition (const gmk_floc *flocp,
@@ -472,19 +472,23 @@ selective_vpath_search (struct vpath *path, const char *file,
             {
               int e;
 
-              EINTRLOOP (e, stat (name, &st)); /* Does it really exist?  */
+              /* Does it really exist?  If so, store the modtime into
+                 *MTIME_PTR for the caller.  */
+              if (! prefetched_stat (name, &st, mtime_ptr, &e))
+                {
+                  STATS_START (STATS_STAT);
+                  EINTRLOOP (e, stat (name, &st));
+                  STATS_STOP (STATS_STAT);
+                  STATS_COUNT (STATS_STATS);
+                  if (e == 0 && mtime_ptr != 0)
+                    *mtime_ptr = FILE_TIMESTAMP_STAT_MODTIME (name, st);
+                }
               if (e != 0)
                 {
                   exists = 0;
                   continue;
                 }
-
-              /* Store the modtime into *MTIME_PTR for the caller.  */
-              if (mtime_ptr != 0)
-                {
-                  *mtime_ptr = FILE_TIMESTAMP_STAT_MODTIME (name, st);
-                  mtime_ptr = 0;
-                }
+              mtime_ptr = 0;
             }
 
           /* We have found a file.
@@ -560,6 +564,57 @@ vpath_search (const char *file, FILE_TIMESTAMP *mtime_ptr,
   return 0;
 }
 
+/* Give prefetch_name() each name selective_vpath_search() may stat() while
+   looking for FILE in PATH, and the directories it looks in.  */
+
+static void
+prefetch_vpath_names (const struct vpath *path, const char *file)
+{
+  const char **vpath = path->searchpath;
+  const char *slash = strrchr (file, '/');
+  unsigned int dplen = slash != 0 ? slash - file : 0;
+  unsigned int flen = strlen (file);
+  char *name = alloca (path->maxlen + 1 + flen + 1);
+  unsigned int i;
+
+  for (i = 0; vpath[i] != 0; ++i)
+    {
+      unsigned int vlen = strlen (vpath[i]);
+      char *p = name;
+
+      memcpy (p, vpath[i], vlen);
+      p += vlen;
+      if (p != name && p[-1] != '/')
+        *p++ = '/';
+      memcpy (p, file, flen + 1);
+
+      prefetch_name (name, (p - name) + flen);
+      prefetch_name (name, dplen > 0 ? (p - name) + dplen : vlen);
+    }
+}
+
+/* Tell prefetch_name() where vpath_search() would look for FILE.  */
+
+void
+vpath_prefetch (const char *file)
+{
+  struct vpath *v;
+
+  if (file[0] == '/'
+#ifdef HAVE_DOS_PATHS
+      || file[0] == '\\' || file[1] == ':'
+#endif
+      || (vpaths == 0 && general_vpath == 0))
+    return;
+
+  for (v = vpaths; v != 0; v = v->next)
+    if (pattern_matches (v->pattern, v->percent, file))
+      prefetch_vpath_names (v, file);
+
+  if (general_vpath != 0)
+    prefetch_vpath_names (general_vpath, file);
+}
+
 
 
 